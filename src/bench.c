@@ -0,0 +1,558 @@
+#include "win64s.h"
+#include "bench.h"
+#include "client.h"
+#include "server.h"
+
+begin_c
+
+static int highest_bit(uint64_t v) { // v != 0
+    int b = 0;
+    if (v >> 32) { v >>= 32; b += 32; }
+    if (v >> 16) { v >>= 16; b += 16; }
+    if (v >> 8)  { v >>= 8;  b += 8; }
+    if (v >> 4)  { v >>= 4;  b += 4; }
+    if (v >> 2)  { v >>= 2;  b += 2; }
+    if (v >> 1)  { b += 1; }
+    return b;
+}
+
+static int histogram_bucket(uint64_t ns) {
+    if (ns < histogram_sub_buckets) { return (int)ns; } // exact below 16ns
+    const int e = highest_bit(ns); // >= 4
+    const int sub = (int)(ns >> (e - 4)) & (histogram_sub_buckets - 1);
+    return (e - 3) * histogram_sub_buckets + sub;
+}
+
+static int64_t histogram_upper_bound(int i) { // largest value that falls into bucket i
+    if (i < histogram_sub_buckets) { return i; }
+    const int e = i / histogram_sub_buckets + 3;
+    const uint64_t lower = (uint64_t)(histogram_sub_buckets + i % histogram_sub_buckets) << (e - 4);
+    return (int64_t)(lower + ((uint64_t)1 << (e - 4)) - 1);
+}
+
+static void histogram_reset(histogram_t* h) {
+    memset(h, 0, sizeof(*h));
+    h->min = INT64_MAX;
+}
+
+static void histogram_record(histogram_t* h, int64_t ns) {
+    if (ns < 0) { ns = 0; } // clock granularity
+    h->buckets[histogram_bucket((uint64_t)ns)]++;
+    h->count++;
+    h->sum += ns;
+    if (ns < h->min) { h->min = ns; }
+    if (ns > h->max) { h->max = ns; }
+}
+
+static int64_t histogram_percentile(const histogram_t* h, double p) {
+    if (h->count == 0) { return 0; }
+    const int64_t rank = (int64_t)(p / 100.0 * (double)h->count + 0.5);
+    int64_t seen = 0;
+    for (int i = 0; i < histogram_buckets; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank && seen > 0) {
+            const int64_t v = histogram_upper_bound(i);
+            return v < h->max ? (v > h->min ? v : h->min) : h->max;
+        }
+    }
+    return h->max;
+}
+
+static void histogram_merge(histogram_t* h, const histogram_t* from) {
+    for (int i = 0; i < histogram_buckets; i++) { h->buckets[i] += from->buckets[i]; }
+    h->count += from->count;
+    h->sum += from->sum;
+    if (from->min < h->min) { h->min = from->min; }
+    if (from->max > h->max) { h->max = from->max; }
+}
+
+histograms_if histograms = {
+    histogram_reset,
+    histogram_record,
+    histogram_percentile,
+    histogram_merge
+};
+
+enum { max_results = 64, max_list = 16, max_producers = 64 };
+
+typedef struct result_s {
+    const char* name;
+    const char* parameter; // what value is: payload bytes, rate, subscribers
+    int64_t value;
+    double per_second; // of concurrent operations, 0 for sequential ones
+    histogram_t h;
+} result_t;
+
+static struct {
+    int64_t iterations; // measured calls per benchmark
+    int64_t warmup;     // calls made before measurement starts
+    int frames;         // publish-to-consume frames
+    int waiters;        // fan-out subscribers blocked in wait
+    int producers;      // publish contention: 1, 2, 4 ... producers
+    int64_t payloads[max_list];
+    int payload_count;
+    int64_t subscribers[max_list];
+    int subscriber_count;
+    result_t results[max_results];
+    int result_count;
+    volatile shared_memory_t* sm;
+    handle_t notification;
+    volatile bool quit; // fan-out waiters
+    volatile bool go;   // producers start together
+} b;
+
+static int option_list(int argc, const char* argv[], const char* name, int64_t* list, int n) {
+    const char* s = option_value(argc, argv, name);
+    if (s == null) { return n; } // defaults
+    int k = 0;
+    while (*s != 0 && k < max_list) {
+        char* end = null;
+        list[k++] = strtoll(s, &end, 10);
+        s = *end == ',' ? end + 1 : end;
+        if (end == s && *s != 0) { break; } // garbage
+    }
+    return k;
+}
+
+static result_t* new_result(const char* name, const char* parameter, int64_t value) {
+    fatal_if_false(b.result_count < max_results);
+    result_t* r = &b.results[b.result_count++];
+    r->name = name;
+    r->parameter = parameter;
+    r->value = value;
+    r->per_second = 0;
+    histograms.reset(&r->h);
+    return r;
+}
+
+static int64_t ns_since(uint64_t time) {
+    return (int64_t)(nanoseconds_since_boot() - time);
+}
+
+static double per_second(const result_t* r) {
+    const histogram_t* h = &r->h;
+    return r->per_second > 0 ? r->per_second : h->sum > 0 ? h->count * 1e9 / h->sum : 0;
+}
+
+static void trace_result(const result_t* r) {
+    const histogram_t* h = &r->h;
+    traceln("%-16s %s=%-6lld n=%-7lld %10.0f/s min %9.3f p50 %9.3f p90 %9.3f p99 %9.3f "
+            "p99.9 %9.3f max %9.3f mean %9.3f us",
+            r->name, r->parameter, (long long)r->value, (long long)h->count, per_second(r),
+            h->min / 1e3, histograms.percentile(h, 50) / 1e3,
+            histograms.percentile(h, 90) / 1e3, histograms.percentile(h, 99) / 1e3,
+            histograms.percentile(h, 99.9) / 1e3, h->max / 1e3,
+            h->count > 0 ? (double)h->sum / h->count / 1e3 : 0.0);
+}
+
+static void set_get(int64_t payload) {
+    char* value = null;
+    fatal_if_null(value = (char*)heap.alloc(payload + 1));
+    memset(value, 'x', payload);
+    value[payload] = 0;
+    result_t* set = new_result("set", "payload", payload);
+    for (int64_t i = -b.warmup; i < b.iterations; i++) {
+        uint64_t time = nanoseconds_since_boot();
+        fatal_if_not_zero(client.set("bench", value));
+        if (i >= 0) { histograms.record(&set->h, ns_since(time)); }
+    }
+    trace_result(set);
+    // values that do not fit into get() are read in place
+    const bool inline_get = payload < 1024;
+    result_t* get = new_result(inline_get ? "get" : "get_blob", "payload", payload);
+    for (int64_t i = -b.warmup; i < b.iterations; i++) {
+        uint64_t time = nanoseconds_since_boot();
+        size_t n = 0;
+        if (inline_get) {
+            n = strlen(client.get("bench"));
+        } else {
+            blob_t blob;
+            const char* v = (const char*)client.get_blob("bench", &blob);
+            fatal_if_null(v);
+            n = strlen(v);
+            fatal_if_false(client.blob_valid(&blob));
+        }
+        if (i >= 0) { histograms.record(&get->h, ns_since(time)); }
+        fatal_if_false(n == (size_t)payload);
+    }
+    trace_result(get);
+    heap.free(value);
+}
+
+static void bench_notify(shared_memory_t* m) {
+    b.sm = m;
+    if (b.notification != null) { events.set(b.notification); }
+}
+
+static void publish_consume() {
+    // latency from frame timestamp taken by producer to the consumer
+    // noticing it: wake through the notifier thread and the frame copy
+    b.notification = events.create();
+    client.notify = bench_notify;
+    fatal_if_not_zero(client.subscribe(1)); // first stream only
+    result_t* r = null;
+    byte* block = null;
+    uint32_t capacity = 0;
+    uint64_t last = 0; // sequence of the last frame measured, starts at the snapshot
+    int32_t observed = -1;
+    for (int k = 0; k < b.frames; ) {
+        bool changed = false;
+        while (!changed) {
+            if (events.wait_or_timeout(b.notification, 3000) != 0) {
+                traceln("TIMEOUT: server is probably dead");
+                exit(1);
+            }
+            changed = streams.at(b.sm, 0)->position != observed;
+        }
+        const uint64_t now = clocks.ticks(&b.sm->clock);
+        volatile shared_stream_t* st = streams.at(b.sm, 0);
+        if (r == null) {
+            volatile shared_directory_t* d = streams.directory(b.sm, 0);
+            r = new_result("publish_consume", "rate_hz", (int64_t)(d->rate + 0.5));
+            capacity = d->frame_bytes;
+            fatal_if_null(block = (byte*)heap.alloc(capacity));
+            // frames up to the snapshot were published before subscribe():
+            // excluded without a warm-up
+            frame_info_t info;
+            client.snapshot(0, block, capacity, &info);
+            last = info.sequence;
+        }
+        observed = st->position;
+        if (observed < 0) { continue; }
+        const int ix = (observed + st->depth - 1) % st->depth;
+        uint64_t timestamp = 0;
+        uint64_t sequence = 0;
+        frames.read(streams.frame(st, ix), block, capacity, &timestamp, &sequence);
+        if (sequence <= last) { continue; }
+        last = sequence;
+        // cycle counters of different cores may differ by a few ticks
+        const int64_t latency = now > timestamp ? (int64_t)clocks.ns(&b.sm->clock, now - timestamp) : 0;
+        histograms.record(&r->h, latency);
+        k++;
+    }
+    fatal_if_not_zero(client.unsubscribe(1));
+    client.notify = null;
+    handle_t n = b.notification;
+    b.notification = null;
+    events.dispose(n);
+    heap.free(block);
+    trace_result(r);
+}
+
+typedef struct waiter_s {
+    thread_t thread;
+    broadcast_t broadcast; // of the group, parity events duplicated
+    volatile int32_t* ack;
+} waiter_t;
+
+static uint32_t WINAPI waiter_proc(void* p) {
+    thread_begin(p)
+    waiter_t* w = (waiter_t*)that;
+    int32_t seen = w->broadcast.shared->generation;
+    while (!b.quit) {
+        if (broadcasts.wait(&w->broadcast, &seen, forever)) { *w->ack = seen; }
+    }
+    thread_end
+}
+
+static volatile int32_t* ack_of(byte* shared, int i) { // line 0 is the group
+    return (volatile int32_t*)(shared + (uint64_t)(i + 1) * cache_line);
+}
+
+static void fanout(int n) {
+    // the same work as server.notify() does for n subscribers of the same
+    // streams: one broadcast of their wake group with `waiters` of them
+    // blocked on it and a walk of the n acknowledgements (a cache line
+    // each, as shared_client_t) for deaf subscribers
+    const uint64_t bytes = ((n + 1) * (uint64_t)cache_line + 4095) / 4096 * 4096;
+    handle_t mapping = mappings.create(bytes);
+    byte* shared = (byte*)mappings.map(mapping, bytes, true);
+    broadcast_t group;
+    broadcasts.init(&group, (broadcast_shared_t*)shared, null);
+    const int w = b.waiters < n ? b.waiters : n;
+    waiter_t* waiters = null;
+    fatal_if_null(waiters = (waiter_t*)heap.alloc((w > 0 ? w : 1) * sizeof(waiter_t)));
+    memset(waiters, 0, (w > 0 ? w : 1) * sizeof(waiter_t));
+    b.quit = false;
+    for (int i = 0; i < w; i++) {
+        handle_t parity[2] = { null, null }; // null on Linux: futex needs none
+        for (int j = 0; j < countof(parity); j++) {
+            if (group.parity[j] != null) { parity[j] = handles.dup(group.parity[j], null, null); }
+        }
+        broadcasts.init(&waiters[i].broadcast, group.shared, parity);
+        waiters[i].ack = ack_of(shared, i);
+        threads.create(&waiters[i].thread, waiter_proc, &waiters[i]);
+    }
+    const int64_t iterations = b.iterations / n > 100 ? b.iterations / n : 100;
+    result_t* r = new_result("notify_fanout", "subscribers", n);
+    int64_t deaf = 0;
+    for (int64_t k = -b.warmup / n; k < iterations; k++) {
+        uint64_t time = nanoseconds_since_boot();
+        const int32_t g = broadcasts.publish(&group);
+        for (int i = 0; i < n; i++) { deaf += g - 1 - *ack_of(shared, i) > 0; }
+        if (k >= 0) { histograms.record(&r->h, ns_since(time)); }
+    }
+    b.quit = true;
+    for (int i = 0; i < w; i++) {
+        broadcasts.interrupt(&waiters[i].broadcast);
+        threads.join(&waiters[i].thread);
+        broadcasts.dispose(&waiters[i].broadcast);
+    }
+    (void)deaf; // counted as notify() does: back to back publishes outrun any waiter
+    broadcasts.dispose(&group);
+    heap.free(waiters);
+    mappings.unmap(shared, bytes);
+    handles.close(mapping);
+    trace_result(r);
+}
+
+typedef struct producer_s {
+    thread_t thread;
+    volatile shared_memory_t* m;
+    int64_t frames;
+    histogram_t h;
+} producer_t;
+
+static uint32_t WINAPI producer_proc(void* p) {
+    thread_begin(p)
+    producer_t* pr = (producer_t*)that;
+    volatile shared_stream_t* st = streams.at(pr->m, 0);
+    byte data[64];
+    memset(data, 0x5A, sizeof(data));
+    while (!b.go) { spin_pause(); }
+    for (int64_t k = 0; k < pr->frames; k++) {
+        uint64_t time = nanoseconds_since_boot();
+        streams.publish(st, data, sizeof(data), clocks.ticks(&pr->m->clock));
+        histograms.record(&pr->h, ns_since(time));
+    }
+    thread_end
+}
+
+static void publish(int n) {
+    // publish() throughput of n producer threads contending for one ring
+    // of a private layout: reservation, frame copy and in-order commit
+    stream_descriptor_t table[] = {{ "bench", 64, 64, 1.0 }};
+    const uint64_t bytes = streams.size(table, 1, 0);
+    shared_memory_t* m = null;
+    fatal_if_null(m = (shared_memory_t*)heap.alloc(bytes));
+    streams.layout(m, table, 1, 0);
+    volatile shared_stream_t* st = streams.at(m, 0);
+    byte data[64];
+    memset(data, 0x5A, sizeof(data));
+    for (int64_t k = 0; k < b.warmup; k++) { streams.publish(st, data, sizeof(data), 0); }
+    producer_t* producers = null;
+    fatal_if_null(producers = (producer_t*)heap.alloc(n * sizeof(producer_t)));
+    memset(producers, 0, n * sizeof(producer_t));
+    const int64_t frames = b.iterations / n > 100 ? b.iterations / n : 100;
+    b.go = false;
+    for (int i = 0; i < n; i++) {
+        producers[i].m = m;
+        producers[i].frames = frames;
+        histograms.reset(&producers[i].h);
+        threads.create(&producers[i].thread, producer_proc, &producers[i]);
+    }
+    uint64_t time = nanoseconds_since_boot();
+    b.go = true;
+    for (int i = 0; i < n; i++) { threads.join(&producers[i].thread); }
+    const int64_t elapsed = ns_since(time);
+    result_t* r = new_result("publish", "producers", n);
+    for (int i = 0; i < n; i++) { histograms.merge(&r->h, &producers[i].h); }
+    r->per_second = elapsed > 0 ? frames * n * 1e9 / elapsed : 0;
+    // every reservation committed, none lost or committed twice
+    fatal_if_false(st->sequence == (uint64_t)(b.warmup + frames * n) &&
+                   st->reserved == st->sequence);
+    heap.free(producers);
+    heap.free(m);
+    trace_result(r);
+}
+
+typedef struct packed_stream_s { // shared_stream_t before cache line padding
+    volatile int32_t position;
+    uint32_t depth;
+    uint32_t stride;
+    volatile int32_t running;
+    volatile uint64_t sequence;
+    volatile uint64_t reserved;
+    // followed by frames
+} packed_stream_t;
+
+typedef struct layout_s { // fields of one stream header and its first frame
+    thread_t reader;
+    volatile int32_t* position;
+    volatile uint64_t* sequence;
+    volatile uint64_t* reserved;
+    volatile uint32_t* stride;
+    volatile shared_frame_t* frame;
+    volatile uint64_t sum; // keeps the reads
+    int64_t elapsed;       // ns the reader took
+    histogram_t h;
+} layout_t;
+
+enum { layout_batch = 64 }; // operations per histogram sample
+
+static uint32_t WINAPI layout_reader(void* p) {
+    thread_begin(p)
+    layout_t* l = (layout_t*)that;
+    uint64_t sum = 0;
+    while (!b.go) { spin_pause(); }
+    uint64_t time = nanoseconds_since_boot();
+    for (int64_t k = 0; k < b.iterations; k += layout_batch) {
+        uint64_t t = nanoseconds_since_boot();
+        for (int i = 0; i < layout_batch; i++) { // what streams.frame() and read() touch
+            sum += *l->stride + l->frame->capacity + l->frame->end;
+        }
+        histograms.record(&l->h, ns_since(t) / layout_batch);
+    }
+    l->elapsed = ns_since(time);
+    l->sum = sum;
+    thread_end
+}
+
+static void layout_measure(const char* writer_name, const char* reader_name, layout_t* l) {
+    // one thread does what producers do to the index fields while the
+    // other reads the never written fields next to them; both run the
+    // same number of operations (no waiting on each other on a single core)
+    histograms.reset(&l->h);
+    b.go = false;
+    threads.create(&l->reader, layout_reader, l);
+    result_t* w = new_result(writer_name, "cache_line", cache_line);
+    b.go = true;
+    uint64_t time = nanoseconds_since_boot();
+    for (int64_t k = 0; k < b.iterations; k += layout_batch) {
+        uint64_t t = nanoseconds_since_boot();
+        for (int i = 0; i < layout_batch; i++) {
+            const uint64_t s = (uint64_t)atomic_add64(l->reserved, 1);
+            *l->sequence = s;
+            *l->position = (int32_t)s;
+        }
+        histograms.record(&w->h, ns_since(t) / layout_batch);
+    }
+    const int64_t elapsed = ns_since(time);
+    threads.join(&l->reader);
+    w->per_second = elapsed > 0 ? w->h.count * layout_batch * 1e9 / elapsed : 0;
+    result_t* r = new_result(reader_name, "cache_line", cache_line);
+    histograms.merge(&r->h, &l->h);
+    r->per_second = l->elapsed > 0 ? r->h.count * layout_batch * 1e9 / l->elapsed : 0;
+    trace_result(w);
+    trace_result(r);
+}
+
+static void layout() {
+    // false sharing: stream header fields as laid out before and after
+    // padding to cache lines, on line aligned memory
+    const uint64_t bytes = sizeof(shared_stream_t) + 2 * (uint64_t)cache_line;
+    byte* memory = null;
+    fatal_if_null(memory = (byte*)heap.alloc(bytes + cache_line));
+    memset(memory, 0, bytes + cache_line);
+    byte* aligned = memory + (cache_line - (uintptr_t)memory % cache_line) % cache_line;
+    layout_t l = {0};
+    packed_stream_t* ps = (packed_stream_t*)aligned;
+    ps->stride = 64;
+    l.position = &ps->position;
+    l.sequence = &ps->sequence;
+    l.reserved = &ps->reserved;
+    l.stride = &ps->stride;
+    l.frame = (volatile shared_frame_t*)(ps + 1);
+    l.frame->capacity = 64 - sizeof(shared_frame_t);
+    layout_measure("packed_writer", "packed_reader", &l);
+    memset(aligned, 0, bytes);
+    volatile shared_stream_t* st = (volatile shared_stream_t*)aligned;
+    st->stride = cache_line;
+    st->depth = 1;
+    l.position = &st->position;
+    l.sequence = &st->sequence;
+    l.reserved = &st->reserved;
+    l.stride = &st->stride;
+    l.frame = (volatile shared_frame_t*)(st + 1);
+    l.frame->capacity = cache_line - sizeof(shared_frame_t);
+    layout_measure("padded_writer", "padded_reader", &l);
+    heap.free(memory);
+}
+
+static void write_json(const char* filename) {
+    FILE* f = fopen(filename, "w");
+    if (f == null) { traceln("fopen(\"%s\") failed %s", filename, last_error()); return; }
+    fprintf(f, "{\n  \"benchmarks\": [\n");
+    for (int i = 0; i < b.result_count; i++) {
+        const result_t* r = &b.results[i];
+        const histogram_t* h = &r->h;
+        fprintf(f, "    {\"name\": \"%s\", \"%s\": %lld, \"count\": %lld, \"min_ns\": %lld, "
+                   "\"mean_ns\": %lld, \"p50_ns\": %lld, \"p90_ns\": %lld, \"p99_ns\": %lld, "
+                   "\"p999_ns\": %lld, \"max_ns\": %lld, \"per_second\": %.0f}%s\n",
+                r->name, r->parameter, (long long)r->value, (long long)h->count,
+                (long long)h->min, (long long)(h->count > 0 ? h->sum / h->count : 0),
+                (long long)histograms.percentile(h, 50), (long long)histograms.percentile(h, 90),
+                (long long)histograms.percentile(h, 99), (long long)histograms.percentile(h, 99.9),
+                (long long)h->max, per_second(r), i < b.result_count - 1 ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    fclose(f);
+}
+
+static void write_csv(const char* filename) {
+    FILE* f = fopen(filename, "w");
+    if (f == null) { traceln("fopen(\"%s\") failed %s", filename, last_error()); return; }
+    fprintf(f, "name,parameter,value,count,min_ns,mean_ns,p50_ns,p90_ns,p99_ns,p999_ns,max_ns,per_second\n");
+    for (int i = 0; i < b.result_count; i++) {
+        const result_t* r = &b.results[i];
+        const histogram_t* h = &r->h;
+        fprintf(f, "%s,%s,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%.0f\n",
+                r->name, r->parameter, (long long)r->value, (long long)h->count,
+                (long long)h->min, (long long)(h->count > 0 ? h->sum / h->count : 0),
+                (long long)histograms.percentile(h, 50), (long long)histograms.percentile(h, 90),
+                (long long)histograms.percentile(h, 99), (long long)histograms.percentile(h, 99.9),
+                (long long)h->max, per_second(r));
+    }
+    fclose(f);
+}
+
+static int bench_main(int argc, const char* argv[]) {
+    const char* s = null;
+    b.iterations = (s = option_value(argc, argv, "--iterations")) != null ? atoll(s) : 100000;
+    b.warmup = (s = option_value(argc, argv, "--warmup")) != null ? atoll(s) : b.iterations / 10;
+    b.frames = (s = option_value(argc, argv, "--frames")) != null ? atoi(s) : 20;
+    b.waiters = (s = option_value(argc, argv, "--waiters")) != null ? atoi(s) : 4;
+    b.producers = (s = option_value(argc, argv, "--producers")) != null ? atoi(s) : 4;
+    const int64_t payloads[] = { 16, 128, 1024, 16384 };
+    const int64_t subscribers[] = { 1, 16, 256, 4096 };
+    memcpy(b.payloads, payloads, sizeof(payloads));
+    memcpy(b.subscribers, subscribers, sizeof(subscribers));
+    b.payload_count = option_list(argc, argv, "--payload", b.payloads, countof(payloads));
+    b.subscriber_count = option_list(argc, argv, "--subscribers", b.subscribers, countof(subscribers));
+    if (b.iterations < 1 || b.warmup < 0 || b.frames < 1 || b.waiters < 0 ||
+        b.producers < 0 || b.producers > max_producers) {
+        traceln("invalid --iterations, --warmup, --frames, --waiters or --producers");
+        return EINVAL;
+    }
+    for (int i = 0; i < b.payload_count; i++) {
+        // payload travels in one uds message (64KB) on Linux
+        if (b.payloads[i] < 1 || b.payloads[i] > 60 * 1024) {
+            traceln("invalid --payload %lld expected 1..%d", (long long)b.payloads[i], 60 * 1024);
+            return EINVAL;
+        }
+    }
+    for (int i = 0; i < b.subscriber_count; i++) {
+        if (b.subscribers[i] < 1 || b.subscribers[i] > 64 * 1024) {
+            traceln("invalid --subscribers %lld", (long long)b.subscribers[i]);
+            return EINVAL;
+        }
+    }
+    soft_realtime_thread();
+    b.result_count = 0;
+    for (int i = 0; i < b.payload_count; i++) { set_get(b.payloads[i]); }
+    publish_consume();
+    for (int i = 0; i < b.subscriber_count; i++) { fanout((int)b.subscribers[i]); }
+    for (int n = 1; n <= b.producers; n = n * 2 < b.producers || n == b.producers ? n * 2 : b.producers) {
+        publish(n);
+    }
+    layout();
+    if ((s = option_value(argc, argv, "--json")) != null) { write_json(s); }
+    if ((s = option_value(argc, argv, "--csv")) != null) { write_csv(s); }
+    return 0;
+}
+
+bench_if bench = {
+    bench_main
+};
+
+end_c
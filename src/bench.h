@@ -0,0 +1,39 @@
+#pragma once
+#include "win64s.h"
+
+begin_c
+
+// Log-linear latency histogram: 16 sub-buckets per power of 2 of
+// nanoseconds, so percentiles are within ~6% of the recorded values.
+// min, max and mean are exact.
+
+enum { histogram_sub_buckets = 16, histogram_buckets = 64 * histogram_sub_buckets };
+
+typedef struct histogram_s {
+    int64_t count;
+    int64_t sum; // nanoseconds
+    int64_t min;
+    int64_t max;
+    int64_t buckets[histogram_buckets];
+} histogram_t;
+
+typedef struct histograms_if {
+    void (*reset)(histogram_t* h);
+    void (*record)(histogram_t* h, int64_t ns);
+    int64_t (*percentile)(const histogram_t* h, double p); // p in [0..100]
+    void (*merge)(histogram_t* h, const histogram_t* from);
+} histograms_if;
+
+extern histograms_if histograms;
+
+typedef struct bench_if {
+    // rpc bench [--iterations n] [--warmup n] [--payload bytes,...]
+    //           [--frames n] [--subscribers n,...] [--waiters n] [--producers n]
+    //           [--json file] [--csv file]
+    // client must be connected
+    int (*main)(int argc, const char* argv[]);
+} bench_if;
+
+extern bench_if bench;
+
+end_c
@@ -1,6 +1,7 @@
 #include "win64s.h"
 #include "client.h"
 #include "server.h"
+#include "journal.h"
 
 begin_c
 
@@ -23,44 +24,393 @@ static void roundtrip() {
     }
     time = seconds_since_boot() - time;
     traceln("client.set() %.3f microseconds\n", time * 1000000.0 / N);
-    traceln("client.get(\"foo\")=\"%s\"\n", client.get("Hello World"));
+    time = seconds_since_boot();
+    for (int i = 0; i < N; i++) {
+        // lock free read of shared memory key/value table, no rpc
+        fatal_if_false(strcmp(client.get("foo"), "bar") == 0);
+    }
+    time = seconds_since_boot() - time;
+    traceln("client.get() %.3f microseconds\n", time * 1000000.0 / N);
+    traceln("client.get(\"Hello World\")=\"%s\"\n", client.get("Hello World"));
+    enum { K = 32 * 1024 }; // large value is placed into shared memory blob arena
+    char* large = null;
+    fatal_if_null(large = (char*)heap.alloc(K));
+    memset(large, 'x', K - 1);
+    large[K - 1] = 0;
+    fatal_if_not_zero(client.set("large", large));
+    heap.free(large);
+    time = seconds_since_boot();
+    size_t bytes = 0;
+    for (int i = 0; i < N; i++) {
+        // zero copy: value is read in place and validated by generation
+        blob_t blob;
+        const char* v = (const char*)client.get_blob("large", &blob);
+        fatal_if_null(v);
+        bytes = strlen(v) + 1;
+        fatal_if_false(client.blob_valid(&blob));
+    }
+    time = seconds_since_boot() - time;
+    traceln("client.get_blob() %.3f microseconds (%d bytes)\n", time * 1000000.0 / N, (int)bytes);
+}
+
+static void uploaded() {
+    // set() through the upload ring: a copy and an occasional doorbell
+    // instead of a call, applied by the server drain thread in order
+    enum { N = 100000 };
+    char value[16];
+    int full = 0;
+    double time = seconds_since_boot();
+    for (int i = 0; i < N; i++) {
+        snprintf(value, sizeof(value), "%d", i);
+        int r = client.upload_set("uploaded", value);
+        while (r == upload_full) {
+            full++;
+            thread_yield(); // let the drain thread catch up
+            r = client.upload_set("uploaded", value);
+        }
+        fatal_if_not_zero(r);
+    }
+    fatal_if_not_zero(client.flush());
+    time = seconds_since_boot() - time;
+    fatal_if_false(strcmp(client.get("uploaded"), value) == 0);
+    traceln("client.upload_set() %.3f microseconds (ring full %d times)\n", time * 1e6 / N, full);
+}
+
+typedef struct upload_check_s {
+    int records;
+    int corrupt;
+} upload_check_t;
+
+static void upload_check(void* that, uint32_t type, const byte* data, uint32_t bytes) {
+    upload_check_t* c = (upload_check_t*)that;
+    if (type == upload_type_corrupt) { c->corrupt++; } else { c->records++; }
+}
+
+static void corrupted_upload() {
+    // the ring is client memory: a header longer than any record must be
+    // dropped and reported by uploads.read(), not copied. A private ring,
+    // the server and its counters are not involved.
+    volatile shared_upload_t* u = null;
+    fatal_if_null(u = (volatile shared_upload_t*)heap.alloc(sizeof(shared_upload_t)));
+    memset((void*)u, 0, sizeof(shared_upload_t));
+    fatal_if_not_zero(uploads.write(u, upload_type_user, "valid", 6));
+    const uint32_t bytes = upload_max_record + 8;
+    upload_record_t* r = (upload_record_t*)(u->data + u->head);
+    r->bytes = bytes;
+    r->type = upload_type_set;
+    memset(r + 1, 'x', bytes);
+    u->head += sizeof(upload_record_t) + bytes;
+    fatal_if_not_zero(uploads.write(u, upload_type_user, "dropped", 8)); // after the bad one
+    upload_check_t check = {0};
+    const int n = uploads.read(u, &check, upload_check);
+    fatal_if_false(n == 1 && check.records == 1 && check.corrupt == 1,
+                   "oversized upload record was not rejected");
+    fatal_if_false(u->tail == u->head, "ring is not handed back");
+    heap.free((void*)u);
+    traceln("oversized upload record rejected\n");
+}
+
+static void batches() {
+    // per item cost of batched and pipelined calls vs batch size
+    enum { N = 64 * 1024, max_batch = 512, name_bytes = 16 };
+    static const int sizes[] = { 1, 8, 64, 512 };
+    static char storage[3][max_batch][name_bytes];
+    static const char* names[max_batch];
+    static const char* absent[max_batch];
+    static const char* values[max_batch];
+    static const char* replies[max_batch];
+    static char buffer[max_batch * name_bytes];
+    for (int i = 0; i < max_batch; i++) {
+        snprintf(storage[0][i], name_bytes, "key%d", i);
+        snprintf(storage[1][i], name_bytes, "absent%d", i);
+        snprintf(storage[2][i], name_bytes, "value%d", i);
+        names[i] = storage[0][i];
+        absent[i] = storage[1][i];
+        values[i] = storage[2][i];
+    }
+    for (int k = 0; k < countof(sizes); k++) {
+        const int b = sizes[k];
+        double time = seconds_since_boot();
+        for (int i = 0; i < N; i += b) { fatal_if_not_zero(client.set_many(b, names, values)); }
+        const double set_many = (seconds_since_boot() - time) / N;
+        time = seconds_since_boot();
+        for (int i = 0; i < N; i += b) {
+            fatal_if_not_zero(client.get_many(b, names, replies, buffer, sizeof(buffer)));
+        }
+        const double get_many = (seconds_since_boot() - time) / N;
+        fatal_if_false(strcmp(replies[b - 1], values[b - 1]) == 0);
+        time = seconds_since_boot();
+        for (int i = 0; i < N; i += b) { // misses: one rpc per batch
+            fatal_if_not_zero(client.get_many(b, absent, replies, buffer, sizeof(buffer)));
+        }
+        const double get_misses = (seconds_since_boot() - time) / N;
+        fatal_if_false(replies[b - 1][0] == 0);
+        time = seconds_since_boot();
+        for (int i = 0; i < N; i += b) {
+            for (int j = 0; j < b; j++) { fatal_if_not_zero(client.submit_set(names[j], values[j])); }
+            fatal_if_not_zero(client.complete());
+        }
+        const double pipelined = (seconds_since_boot() - time) / N;
+        traceln("batch %3d set_many %.3f get_many %.3f (misses %.3f) submit_set %.3f microseconds\n",
+                b, set_many * 1e6, get_many * 1e6, get_misses * 1e6, pipelined * 1e6);
+    }
+}
+
+enum { stress_max_threads = 64 };
+
+typedef struct stress_thread_s {
+    session_t* session; // of this thread only: no call shares a connection
+    volatile int64_t calls;
+    byte padding[cache_line - 16]; // counters of threads do not share lines
+} stress_thread_t;
+
+static struct {
+    volatile bool stop;
+    stress_thread_t* thread; // [n] on line aligned memory
+} stress;
+
+static uint32_t WINAPI stress_thread_proc(void* p) {
+    thread_begin(p)
+    stress_thread_t* st = (stress_thread_t*)that;
+    char name[32];
+    snprintf(name, sizeof(name), "stress%d", (int)(st - stress.thread));
+    while (!stress.stop) {
+        fatal_if_not_zero(sessions.set(st->session, name, "value")); // serialized on the kv writer lock
+        sessions.get(st->session, "absent"); // miss: rpc dispatched without any lock
+        st->calls += 2;
+    }
+    thread_end
+}
+
+static void stress_test(int n) {
+    // rpc calls throughput of 1, 2, 4 ... n concurrent client threads
+    thread_t threads_pool[stress_max_threads];
+    memset(threads_pool, 0, sizeof(threads_pool));
+    byte* memory = null;
+    fatal_if_null(memory = (byte*)heap.alloc(n * sizeof(stress_thread_t) + cache_line));
+    stress.thread = (stress_thread_t*)(memory + (cache_line - (uintptr_t)memory % cache_line) % cache_line);
+    memset(stress.thread, 0, n * sizeof(stress_thread_t));
+    for (int i = 0; i < n; i++) {
+        fatal_if_not_zero(sessions.open(&stress.thread[i].session, null, null));
+    }
+    for (int k = 1; ; k = k * 2 < n ? k * 2 : n) {
+        stress.stop = false;
+        for (int i = 0; i < k; i++) { stress.thread[i].calls = 0; }
+        double time = seconds_since_boot();
+        for (int i = 0; i < k; i++) {
+            threads.create(&threads_pool[i], stress_thread_proc, &stress.thread[i]);
+        }
+        sleep(1.0);
+        stress.stop = true;
+        for (int i = 0; i < k; i++) { threads.join(&threads_pool[i]); }
+        time = seconds_since_boot() - time;
+        int64_t calls = 0;
+        for (int i = 0; i < k; i++) { calls += stress.thread[i].calls; }
+        traceln("%2d threads %9.0f calls/s %.3f microseconds per call\n",
+                k, calls / time, time * 1000000.0 * k / (calls > 0 ? calls : 1));
+        if (k == n) { break; }
+    }
+    for (int i = 0; i < n; i++) {
+        fatal_if_not_zero(sessions.close(stress.thread[i].session));
+    }
+    heap.free(memory);
+    stress.thread = null;
+}
+
+enum { sessions_max = 64 };
+
+typedef struct session_test_s {
+    thread_t thread;
+    session_t* session;
+    handle_t notification;
+    int stream;
+    int64_t frames;
+    uint64_t overrun;
+    uint64_t gaps;
+} session_test_t;
+
+static void session_notify(session_t* s, void* that) {
+    events.set(((session_test_t*)that)->notification);
+}
+
+static uint32_t WINAPI session_thread_proc(void* p) {
+    // lossless reader of one stream on a session of its own
+    thread_begin(p)
+    session_test_t* t = (session_test_t*)that;
+    volatile shared_memory_t* m = sessions.memory(t->session);
+    const uint32_t capacity = streams.directory(m, t->stream)->frame_bytes;
+    byte* block = null;
+    fatal_if_null(block = (byte*)heap.alloc(capacity));
+    fatal_if_not_zero(sessions.subscribe(t->session, 1ULL << t->stream));
+    uint64_t expected = 0;
+    const double deadline = seconds_since_boot() + 2.0;
+    while (seconds_since_boot() < deadline) {
+        if (events.wait_or_timeout(t->notification, 3000) != 0) {
+            traceln("TIMEOUT: server is probably dead");
+            exit(1);
+        }
+        frame_info_t info;
+        while (sessions.read_next(t->session, t->stream, block, capacity, &info)) {
+            t->overrun += info.overrun;
+            if (expected != 0 && info.sequence != expected + info.overrun) { t->gaps++; }
+            expected = info.sequence + 1;
+            t->frames++;
+        }
+    }
+    fatal_if_not_zero(sessions.unsubscribe(t->session, 1ULL << t->stream));
+    heap.free(block);
+    thread_end
+}
+
+static void sessions_test(int n) {
+    // n independent sessions in this process, each on its own thread with
+    // its own stream; all of them share a single mapping of the server memory
+    session_test_t* tests = null;
+    fatal_if_null(tests = (session_test_t*)heap.alloc(n * sizeof(session_test_t)));
+    memset(tests, 0, n * sizeof(session_test_t));
+    for (int i = 0; i < n; i++) {
+        session_test_t* t = &tests[i];
+        t->notification = events.create();
+        fatal_if_not_zero(sessions.open(&t->session, session_notify, t));
+        fatal_if_false(sessions.memory(t->session) == sessions.memory(tests[0].session));
+        t->stream = i % (int)sessions.memory(t->session)->stream_count;
+    }
+    for (int i = 0; i < n; i++) { threads.create(&tests[i].thread, session_thread_proc, &tests[i]); }
+    for (int i = 0; i < n; i++) { threads.join(&tests[i].thread); }
+    for (int i = 0; i < n; i++) {
+        session_test_t* t = &tests[i];
+        traceln("session[%d] \"%s\" %lld frames overrun %llu unaccounted gaps %llu", i,
+                streams.directory(sessions.memory(t->session), t->stream)->name, (long long)t->frames,
+                (unsigned long long)t->overrun, (unsigned long long)t->gaps);
+        fatal_if_not_zero(sessions.close(t->session));
+        events.dispose(t->notification);
+    }
+    heap.free(tests);
+}
+
+enum { wait_block, wait_hybrid, wait_poll, wait_modes };
+
+static const char* wait_mode_names[wait_modes] = { "block", "hybrid", "poll" };
+
+static struct {
+    int mode;
+    double spin; // seconds of spinning before hybrid falls back to blocking
+    int64_t spin_hits;
+    int64_t fallbacks; // hybrid spin budget exhausted
+} consumer = { wait_block, 100e-6 };
+
+static bool positions_changed(int n, const int32_t* observed) {
+    for (int i = 0; i < n; i++) {
+        if (streams.at(sm, i)->position != observed[i]) { return true; }
+    }
+    return false;
+}
+
+// returns false on timeout; n == 0 until the first notification delivered sm
+static bool wait_for_frames(int n, const int32_t* observed) {
+    if (consumer.mode != wait_block && n > 0) {
+        // isolated core consumers: spin on stream positions instead of
+        // hopping through notifier thread and notification event
+        const double deadline = seconds_since_boot() +
+            (consumer.mode == wait_poll ? 3.0 : consumer.spin);
+        for (;;) {
+            for (int i = 0; i < 1024; i++) {
+                if (positions_changed(n, observed)) { consumer.spin_hits++; return true; }
+                spin_pause();
+            }
+            if (seconds_since_boot() >= deadline) { break; }
+            thread_yield(); // producer may share this core
+        }
+        if (consumer.mode == wait_poll) { return false; }
+        consumer.fallbacks++;
+    }
+    for (;;) {
+        // notification may be stale after spin hits: wait until positions change
+        if (events.wait_or_timeout(notification, 3000) != 0) { return false; }
+        if (n == 0 || positions_changed(n, observed)) { return true; }
+    }
+}
+
+static double since(uint64_t start, uint64_t ticks) { // seconds, for traces
+    return ticks >= start ? clocks.ns(&sm->clock, ticks - start) / 1e9 :
+                           -(clocks.ns(&sm->clock, start - ticks) / 1e9);
+}
+
+static bool torn(const byte* block, uint32_t bytes, uint32_t* k) {
+    // test frames are filled with one letter, recorded frames are not letters
+    *k = 1;
+    while (*k < bytes && block[*k] == block[0]) { (*k)++; }
+    return *k != bytes && (sm->options & memory_replayed) == 0;
 }
 
 static void streaming() {
-    double start_time = seconds_since_boot();
+    uint64_t start_time = 0; // ticks
+    consumer.spin_hits = 0;
+    consumer.fallbacks = 0;
+    events.reset(notification); // stale from previous streaming() run
     fatal_if_not_zero(client.start());
-    double max_latency[countof(sm->streams)] = {0};
-    int32_t position[countof(sm->streams)];
-    for (int i = 0; i < countof(position); i++) { position[i] = -1; }
+    int n = 0; // number of streams known after the first notification
+    uint64_t* max_latency = null; // nanoseconds
+    uint64_t* last = null; // sequence of the last frame seen, starts at the snapshot
+    int32_t* observed = null; // stream positions as of last wait_for_frames()
+    byte* block = null;
+    uint32_t capacity = 0;
     for (int k = 0; k < 27; k++) {
-        int r = events.wait_or_timeout(notification, 3000);
-        if (r != 0) {
+        if (!wait_for_frames(n, observed)) {
             traceln("TIMEOUT: server is probably dead");
             exit(1);
         }
-        for (int i = 0; i < countof(sm->streams); i++) {
-            volatile shared_stream_t* st = &sm->streams[i];
-            if (st->position >= 0) {
-                int ix = (st->position + countof(st->frames) - 1) % countof(st->frames);
-                if (ix != position[i]) {
-                    uint32_t mc_before = st->frames[ix].mc;
-                    byte data = st->frames[ix].data[0];
-                    uint32_t mc_after = st->frames[ix].mc;
-                    position[i] = ix;
-                    if (mc_before != mc_after) {
-                        traceln("%6.3f IGNORE stream[%d].frames[%d] because it was modified in-flight",
-                            st->frames[ix].timestamp - start_time, i, ix);
+        if (last == null) {
+            n = (int)sm->stream_count;
+            fatal_if_null(max_latency = (uint64_t*)heap.alloc(n * sizeof(uint64_t)));
+            fatal_if_null(last = (uint64_t*)heap.alloc(n * sizeof(uint64_t)));
+            fatal_if_null(observed = (int32_t*)heap.alloc(n * sizeof(int32_t)));
+            for (int i = 0; i < n; i++) {
+                uint32_t c = streams.directory(sm, i)->frame_bytes;
+                capacity = c > capacity ? c : capacity;
+            }
+            fatal_if_null(block = (byte*)heap.alloc(capacity));
+            start_time = clocks.ticks(&sm->clock);
+            for (int i = 0; i < n; i++) {
+                // state as of start(): published before this client joined,
+                // so its age is not a latency
+                max_latency[i] = 0;
+                frame_info_t info;
+                uint32_t at = 0;
+                if (client.snapshot(i, block, capacity, &info) && torn(block, info.bytes, &at)) {
+                    traceln("TORN snapshot stream[%d] seq=%llu [%d]=0x%02X != 0x%02X",
+                            i, (unsigned long long)info.sequence, at, block[at], block[0]);
+                } else if (verbose && info.sequence != 0) {
+                    traceln("%6.3f stream[%d] snapshot seq=%llu",
+                            since(start_time, info.timestamp), i, (unsigned long long)info.sequence);
+                }
+                last[i] = info.sequence;
+            }
+        }
+        for (int i = 0; i < n; i++) {
+            volatile shared_stream_t* st = streams.at(sm, i);
+            observed[i] = st->position;
+            if (observed[i] >= 0) {
+                int ix = (observed[i] + st->depth - 1) % st->depth;
+                uint64_t timestamp = 0;
+                uint64_t seq = 0;
+                uint32_t bytes = frames.read(streams.frame(st, ix), block, capacity, &timestamp, &seq);
+                if (seq > last[i]) {
+                    byte data = block[0];
+                    last[i] = seq;
+                    uint32_t at = 0;
+                    if (torn(block, bytes, &at)) {
+                        traceln("%6.3f TORN stream[%d].frames[%d] [%d]=0x%02X != 0x%02X",
+                            since(start_time, timestamp), i, ix, at, block[at], data);
                     } else {
-                        double latency = (seconds_since_boot() - st->frames[ix].timestamp) * 1000 * 1000;
-                        if (latency < 1000 * 1000 && latency > max_latency[i]) {
-                            max_latency[i] = latency;
-                        } else {
-                            // latency greater then a second happens when a client connects to
-                            // already running service
-                        }
+                        const uint64_t now = clocks.ticks(&sm->clock);
+                        // cycle counters of different cores may differ by a few ticks
+                        const uint64_t latency = now > timestamp ? clocks.ns(&sm->clock, now - timestamp) : 0;
+                        if (latency > max_latency[i]) { max_latency[i] = latency; }
                         if (verbose) {
-                            traceln("%6.3f stream[%d].frames[%02d].data = 0x%02X '%c' (mc=%d) latency=%.3fus",
-                                st->frames[ix].timestamp - start_time, i, ix, data, data, mc_after, latency);
+                            traceln("%6.3f stream[%d].frames[%02d].data = 0x%02X '%c' bytes=%d (seq=%llu) latency=%.3fus",
+                                since(start_time, timestamp), i, ix, data, data, bytes,
+                                (unsigned long long)seq, latency / 1e3);
                         }
                     }
                 }
@@ -68,18 +418,139 @@ static void streaming() {
         }
     }
     fatal_if_not_zero(client.stop());
-    for (int i = 0; i < countof(position); i++) {
-        traceln("latency[%d]=%.1f us", i, max_latency[i]);
+    const char* mode = wait_mode_names[consumer.mode];
+    for (int i = 0; i < n; i++) {
+        traceln("%-6s latency[%d] \"%s\"=%.1f us", mode, i, streams.directory(sm, i)->name, max_latency[i] / 1e3);
+    }
+    if (consumer.mode != wait_block) {
+        traceln("%-6s spin hits=%lld fallbacks=%lld", mode,
+                (long long)consumer.spin_hits, (long long)consumer.fallbacks);
     }
     // observed max latency upto 200 microseconds
+    heap.free(block);
+    heap.free(observed);
+    heap.free(last);
+    heap.free(max_latency);
+}
+
+static void lossless(int count) {
+    // every frame of the first stream in order: sequence gaps are only
+    // allowed where read_next() reported the ring lapping the reader
+    fatal_if_not_zero(client.subscribe(1));
+    byte* block = null;
+    uint32_t capacity = 0;
+    uint64_t expected = 0;
+    uint64_t overruns = 0;
+    uint64_t gaps = 0;
+    int frames_read = 0;
+    while (frames_read < count) {
+        if (events.wait_or_timeout(notification, 3000) != 0) {
+            traceln("TIMEOUT: server is probably dead");
+            exit(1);
+        }
+        if (block == null) { // sm is known after the first notification
+            capacity = streams.directory(sm, 0)->frame_bytes;
+            fatal_if_null(block = (byte*)heap.alloc(capacity));
+        }
+        frame_info_t info;
+        while (frames_read < count && client.read_next(0, block, capacity, &info)) {
+            overruns += info.overrun;
+            if (expected != 0 && info.sequence != expected + info.overrun) { gaps++; }
+            expected = info.sequence + 1;
+            frames_read++;
+        }
+    }
+    fatal_if_not_zero(client.unsubscribe(1));
+    traceln("lossless \"%s\" %d frames overrun %llu unaccounted gaps %llu",
+            streams.directory(sm, 0)->name, frames_read,
+            (unsigned long long)overruns, (unsigned long long)gaps);
+    heap.free(block);
+}
+
+static void history() {
+    // every frame of the first stream behind its ring, read without rpc
+    // from the stream journal (server --journal MB)
+    volatile shared_journal_t* j = streams.journal(streams.at(sm, 0));
+    if (j == null) { return; }
+    const uint32_t capacity = streams.directory(sm, 0)->frame_bytes;
+    byte* block = null;
+    fatal_if_null(block = (byte*)heap.alloc(capacity));
+    uint64_t first = 0;
+    uint64_t last = 0;
+    journals.range(j, &first, &last);
+    uint64_t frames_read = 0;
+    uint64_t lost = 0; // overwritten while they were read
+    uint64_t torn = 0;
+    const uint64_t start = nanoseconds_since_boot();
+    for (uint64_t sequence = first; sequence <= last; sequence++) {
+        frame_info_t info;
+        if (!journals.read(j, sequence, block, capacity, &info)) {
+            lost++;
+        } else {
+            uint32_t k = 1;
+            while (k < info.bytes && block[k] == block[0]) { k++; }
+            if (k != info.bytes && (sm->options & memory_replayed) == 0) { torn++; }
+            frames_read++;
+        }
+    }
+    const uint64_t elapsed = nanoseconds_since_boot() - start;
+    const uint64_t now = clocks.ticks(&sm->clock);
+    const uint64_t second_ago = journals.find(j, now - sm->clock.ticks_per_second);
+    traceln("history \"%s\" frames [%llu..%llu] read %llu lost %llu torn %llu %.3f us per frame, "
+            "first of the last second %llu",
+            streams.directory(sm, 0)->name, (unsigned long long)first, (unsigned long long)last,
+            (unsigned long long)frames_read, (unsigned long long)lost, (unsigned long long)torn,
+            frames_read > 0 ? elapsed / 1e3 / frames_read : 0.0, (unsigned long long)second_ago);
+    heap.free(block);
 }
 
 int client_test(int argc, const char* argv[]) {
+    // --wait block|hybrid|poll|all (all compares the three modes one after another)
+    // --spin microseconds: hybrid spin budget before blocking (default 100)
+    // --stress threads: rpc throughput with 1, 2, 4 ... concurrent threads
+    // --lossless frames: read every frame of the first stream with read_next()
+    // --sessions n: n sessions of their own on n threads reading streams losslessly
+    const char* wait = option_value(argc, argv, "--wait");
+    const char* stress_threads = option_value(argc, argv, "--stress");
+    const char* spin = option_value(argc, argv, "--spin");
+    const char* lossless_frames = option_value(argc, argv, "--lossless");
+    const char* session_count = option_value(argc, argv, "--sessions");
+    int first = wait_block;
+    int last = wait_block;
+    for (int m = 0; m < wait_modes && wait != null; m++) {
+        if (strcmp(wait, wait_mode_names[m]) == 0) { first = m; last = m; }
+    }
+    if (wait != null && strcmp(wait, "all") == 0) { last = wait_modes - 1; }
+    if (spin != null) { consumer.spin = atof(spin) / (1000 * 1000); }
     soft_realtime_thread();
     roundtrip();
+    batches();
+    uploaded();
+    corrupted_upload();
+    if (stress_threads != null) {
+        int n = atoi(stress_threads);
+        if (n < 1 || n > stress_max_threads) {
+            traceln("invalid --stress %s expected 1..%d threads", stress_threads, stress_max_threads);
+            return EINVAL;
+        }
+        stress_test(n);
+    }
+    if (session_count != null) {
+        int n = atoi(session_count);
+        if (n < 1 || n > sessions_max) {
+            traceln("invalid --sessions %s expected 1..%d", session_count, sessions_max);
+            return EINVAL;
+        }
+        sessions_test(n);
+    }
     notification = events.create();
     client.notify = notify;
-    streaming();
+    for (int m = first; m <= last; m++) {
+        consumer.mode = m;
+        streaming();
+    }
+    if (lossless_frames != null) { lossless(atoi(lossless_frames)); }
+    history();
     client.notify = null; // no more calls to client notify past this point
     handle_t n = notification;
     notification = null;
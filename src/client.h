@@ -1,23 +1,116 @@
 #pragma once
 #include "win64s.h"
 #include "server.h"
+#include "kv.h"
+#include "upload.h"
 
 begin_c
 
+enum { client_max_in_flight = 64 }; // pipelined submit_set() calls
+
 typedef struct client_if {
     void (*notify)(shared_memory_t* shared_memory);
-    int (*start)();
-    int (*stop)();
+    // start() and subscribe() return with a consistent cut of the streams
+    // they added (see snapshot()); notify() is then called only for frames
+    // past it, so a client joining a running server begins within one frame
+    // period without stale frames or a warm-up to discard
+    int (*start)(); // subscribe() to all streams
+    int (*stop)();  // unsubscribe() from all streams
+    // streams is a bitmask of stream indices (see streams.directory())
+    int (*subscribe)(uint64_t streams);
+    int (*unsubscribe)(uint64_t streams);
+    // applied by the server in upload ring order, rpc for values too long for a record
     int (*set)(const char* name, const char* value);
-    const char* (*get)(const char* name);
+    const char* (*get)(const char* name); // "" for values longer than 1023 characters
+    // zero copy: returns pointer to the value inside shared memory or null if
+    // value is absent or short enough to live in kv bucket (use get()).
+    // The pointer stays readable but the value may be replaced at any time:
+    // whatever has been read is consistent only if blob_valid() afterwards.
+    const void* (*get_blob)(const char* name, blob_t* blob);
+    bool (*blob_valid)(const blob_t* blob);
+    // lossless consumer: every frame of a subscribed stream in order, starting
+    // with the first one after the snapshot taken by subscribe(). Copies min(info->bytes, capacity) bytes; false if there is
+    // no new frame. info->overrun counts frames lost because the ring lapped
+    // the reader (see server --backpressure)
+    bool (*read_next)(int stream, void* data, uint32_t capacity, frame_info_t* info);
+    // latest frame of the stream at the time of subscribe(): info->sequence
+    // is the snapshot (0 if the stream had no frames yet). False if there is
+    // no frame or it has been overwritten in the ring and in the journal since
+    bool (*snapshot)(int stream, void* data, uint32_t capacity, frame_info_t* info);
+    // batches: one rpc call for n pairs; get_many() reads hits from shared
+    // memory and fetches misses in one call, values[i] point into buffer
+    // and are "" for absent names
+    int (*set_many)(int n, const char* names[], const char* values[]);
+    int (*get_many)(int n, const char* names[], const char* values[], char* buffer, int bytes);
+    // pipelined set(): keeps up to client_max_in_flight calls outstanding,
+    // complete() waits for all of them and returns the first error.
+    // Other calls must not be made while submitted calls are incomplete.
+    int (*submit_set)(const char* name, const char* value);
+    int (*complete)();
+    // upload ring (see upload.h): the record is copied into the client's
+    // own ring in shared memory and handled by the server later, no rpc.
+    // Returns 0, upload_full until the server drains the ring or upload_too_long
+    int (*upload)(uint32_t type, const void* data, uint32_t bytes);
+    int (*upload_set)(const char* name, const char* value); // set() applied by the drain thread
+    int (*flush)(); // waits until the server has drained everything uploaded so far
     int (*connect)();
     int (*test)(int argc, const char* argv[]);
     int (*disconnect)();
     void (*shutdown)(); // shutdown the server (instead of disconnect)
+    // read only mapping of server shared memory, null if not connected
+    volatile shared_memory_t* (*view)();
+    // observers that only read (rpc stats): read only mapping of the server
+    // shared memory without connect(): no client slot, upload ring or
+    // notifier thread. Never starts a server in process; null (traced) if
+    // no server is listening. detach() unmaps it
+    volatile shared_memory_t* (*attach)();
+    void (*detach)();
 } client_if;
 
 extern client_if client;
 
+// Independent connections to the server inside one process (gateways
+// serving many consumers): each session owns its rpc binding, client slot
+// (subscriptions, cursors, snapshot, upload ring) and notifier thread, and
+// may be used from its own thread. Sessions connected to the same server
+// share one mapping of its shared memory. client_if above is the session
+// opened by client.connect(); the calls below are the same for a session.
+
+typedef struct session_s session_t;
+
+typedef struct sessions_if {
+    // connects a new session; notify (may be null) is called on the
+    // session's notifier thread for frames past its start() snapshot.
+    // Returns 0 and *s or ERROR_NOT_CONNECTED and null
+    int (*open)(session_t** s, void (*notify)(session_t* s, void* that), void* that);
+    // completes pipelined calls, disconnects and joins the notifier thread;
+    // the mapping is unmapped with the last session of its server
+    int (*close)(session_t* s);
+    // writable mapping of the server shared memory, null if not connected
+    volatile shared_memory_t* (*memory)(session_t* s);
+    volatile shared_memory_t* (*view)(session_t* s); // read only, see client.view()
+    int (*start)(session_t* s);
+    int (*stop)(session_t* s);
+    int (*subscribe)(session_t* s, uint64_t streams);
+    int (*unsubscribe)(session_t* s, uint64_t streams);
+    int (*set)(session_t* s, const char* name, const char* value);
+    const char* (*get)(session_t* s, const char* name); // thread local buffer, as client.get()
+    const void* (*get_blob)(session_t* s, const char* name, blob_t* blob);
+    bool (*blob_valid)(session_t* s, const blob_t* blob);
+    bool (*read_next)(session_t* s, int stream, void* data, uint32_t capacity, frame_info_t* info);
+    bool (*snapshot)(session_t* s, int stream, void* data, uint32_t capacity, frame_info_t* info);
+    int (*set_many)(session_t* s, int n, const char* names[], const char* values[]);
+    int (*get_many)(session_t* s, int n, const char* names[], const char* values[],
+                    char* buffer, int bytes);
+    int (*submit_set)(session_t* s, const char* name, const char* value);
+    int (*complete)(session_t* s);
+    int (*upload)(session_t* s, uint32_t type, const void* data, uint32_t bytes);
+    int (*upload_set)(session_t* s, const char* name, const char* value);
+    int (*flush)(session_t* s);
+} sessions_if;
+
+extern sessions_if sessions;
+
 // client.shutdown() is necessary when both are inside single process
 // or for situation when server needs to be stopped from the outside
 // (e.g. server code update)
@@ -0,0 +1,139 @@
+#include "win64s.h"
+#include "journal.h"
+
+begin_c
+
+static uint64_t power_of_2(uint64_t n) { // smallest >= n
+    uint64_t p = 1;
+    while (p < n) { p <<= 1; }
+    return p;
+}
+
+static uint64_t align8(uint64_t n) { return (n + 7) & ~(uint64_t)7; }
+
+static uint64_t journal_data_bytes(uint32_t frame_bytes, uint64_t bytes) {
+    // at least two of the largest frames: the one being read and the one being appended
+    const uint64_t minimum = 2 * align8(frame_bytes);
+    return power_of_2(bytes > minimum ? bytes : minimum);
+}
+
+static uint32_t journal_entries(uint32_t frame_bytes, uint64_t data_bytes) {
+    return (uint32_t)power_of_2(4 * data_bytes / (frame_bytes > 0 ? frame_bytes : 1));
+}
+
+static uint64_t journals_size(uint32_t frame_bytes, uint64_t bytes) {
+    if (bytes == 0) { return 0; }
+    const uint64_t data_bytes = journal_data_bytes(frame_bytes, bytes);
+    return sizeof(shared_journal_t) +
+           journal_entries(frame_bytes, data_bytes) * sizeof(shared_journal_entry_t) + data_bytes;
+}
+
+static volatile shared_journal_entry_t* journal_index(volatile shared_journal_t* j) {
+    return (volatile shared_journal_entry_t*)(j + 1);
+}
+
+static volatile byte* journal_data(volatile shared_journal_t* j) {
+    return (volatile byte*)(journal_index(j) + j->entries);
+}
+
+static void journals_layout(volatile shared_journal_t* j, uint32_t frame_bytes, uint64_t bytes) {
+    assert(bytes > 0 && (uintptr_t)j % cache_line == 0);
+    j->data_bytes = journal_data_bytes(frame_bytes, bytes);
+    j->entries = journal_entries(frame_bytes, j->data_bytes);
+    j->frame_bytes = frame_bytes;
+    j->sequence = 0;
+    j->head = 0;
+    memset((void*)journal_index(j), 0, j->entries * sizeof(shared_journal_entry_t));
+}
+
+static void journals_append(volatile shared_journal_t* j, const void* data, uint32_t bytes,
+                            uint64_t timestamp, uint64_t sequence) {
+    assert(bytes <= j->frame_bytes);
+    volatile shared_journal_entry_t* e = journal_index(j) + (sequence & (j->entries - 1));
+    const uint64_t position = j->head;
+    e->sequence = 0; // readers of the frame indexed here before give up
+    j->head = position + align8(bytes);
+    fence_release(); // entry and head are visible before the payload they cover is overwritten
+    const uint64_t at = position & (j->data_bytes - 1);
+    const uint64_t first = bytes < j->data_bytes - at ? bytes : j->data_bytes - at; // wraps
+    memcpy((void*)(journal_data(j) + at), data, (size_t)first);
+    memcpy((void*)journal_data(j), (const byte*)data + first, (size_t)(bytes - first));
+    e->timestamp = timestamp;
+    e->position = position;
+    e->bytes = bytes;
+    fence_release(); // entry is complete before it names its frame
+    e->sequence = sequence;
+    j->sequence = sequence;
+}
+
+static bool journal_entry(volatile shared_journal_t* j, uint64_t sequence, shared_journal_entry_t* copy) {
+    volatile shared_journal_entry_t* e = journal_index(j) + (sequence & (j->entries - 1));
+    copy->sequence = e->sequence;
+    fence_acquire(); // entry names the frame before its fields are read
+    copy->timestamp = e->timestamp;
+    copy->position = e->position;
+    copy->bytes = e->bytes;
+    return copy->sequence == sequence && copy->bytes <= j->frame_bytes &&
+           j->head - copy->position <= j->data_bytes;
+}
+
+static void journals_range(volatile shared_journal_t* j, uint64_t* first, uint64_t* last) {
+    *last = j->sequence;
+    fence_acquire(); // sequence is read before the entries
+    // entries are valid from some sequence on: older ones have been reused
+    // or their payload overwritten
+    uint64_t lo = *last >= j->entries ? *last - j->entries + 1 : 1;
+    uint64_t hi = *last + 1;
+    while (lo < hi) {
+        const uint64_t mid = lo + (hi - lo) / 2;
+        shared_journal_entry_t e;
+        if (journal_entry(j, mid, &e)) { hi = mid; } else { lo = mid + 1; }
+    }
+    *first = lo;
+}
+
+static bool journals_read(volatile shared_journal_t* j, uint64_t sequence, void* data, uint32_t capacity,
+                          frame_info_t* info) {
+    if (sequence == 0 || sequence > j->sequence) { return false; }
+    fence_acquire(); // sequence is read before the entry
+    shared_journal_entry_t e;
+    if (!journal_entry(j, sequence, &e)) { return false; }
+    const uint32_t n = e.bytes < capacity ? e.bytes : capacity;
+    const uint64_t at = e.position & (j->data_bytes - 1);
+    const uint64_t first = n < j->data_bytes - at ? n : j->data_bytes - at;
+    memcpy(data, (const void*)(journal_data(j) + at), (size_t)first);
+    memcpy((byte*)data + first, (const void*)journal_data(j), (size_t)(n - first));
+    fence_acquire(); // payload is read before it is checked for having been overwritten
+    volatile shared_journal_entry_t* v = journal_index(j) + (sequence & (j->entries - 1));
+    if (v->sequence != sequence || j->head - e.position > j->data_bytes) { return false; }
+    info->sequence = sequence;
+    info->timestamp = e.timestamp;
+    info->overrun = 0;
+    info->bytes = e.bytes;
+    return true;
+}
+
+static uint64_t journals_find(volatile shared_journal_t* j, uint64_t ticks) {
+    uint64_t first = 0;
+    uint64_t last = 0;
+    journals_range(j, &first, &last);
+    uint64_t lo = first;
+    uint64_t hi = last + 1;
+    while (lo < hi) { // overwritten entries count as older than ticks
+        const uint64_t mid = lo + (hi - lo) / 2;
+        shared_journal_entry_t e;
+        if (journal_entry(j, mid, &e) && e.timestamp >= ticks) { hi = mid; } else { lo = mid + 1; }
+    }
+    return lo <= last ? lo : 0;
+}
+
+journals_if journals = {
+    journals_size,
+    journals_layout,
+    journals_append,
+    journals_range,
+    journals_read,
+    journals_find
+};
+
+end_c
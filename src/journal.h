@@ -0,0 +1,62 @@
+#pragma once
+#include "win64s.h"
+#include "server.h"
+
+begin_c
+
+// Deep history of a stream behind its hot ring. Every committed frame is
+// also appended to the stream journal: payload goes into a large ring of
+// bytes, an index entry per sequence number (index[sequence % entries])
+// records where. Frames stay readable until either the index or the
+// payload ring wraps, so the history is as deep as memory (or the file
+// behind the mapping, see server --memory-file) allows while the hot
+// ring stays a few cache resident frames.
+//
+// Readers never block the producer: an entry is invalidated before its
+// slot is reused and `head` claims payload bytes before they are
+// overwritten. A reader copies and then checks that neither happened.
+
+typedef struct shared_journal_entry_s { // index entry of one frame
+    volatile uint64_t sequence; // of the frame, 0 while the entry is rewritten
+    uint64_t timestamp;         // clocks.ticks() of the frame
+    uint64_t position;          // of the payload: bytes appended before it
+    uint32_t bytes;             // of payload
+    uint32_t reserved;
+} shared_journal_entry_t;
+
+typedef struct shared_journal_s {
+    uint64_t data_bytes;  // of the payload ring, power of 2
+    uint32_t entries;     // of the index, power of 2
+    uint32_t frame_bytes; // largest payload
+    uint64_t padding0[cache_line / 8 - 2];
+    volatile uint64_t sequence; // of the last appended frame
+    volatile uint64_t head;     // payload bytes ever claimed, below head - data_bytes is overwritten
+    uint64_t padding1[cache_line / 8 - 2];
+    // followed by shared_journal_entry_t index[entries] and byte data[data_bytes]
+} shared_journal_t;
+
+static_assertion(sizeof(shared_journal_t) == 2 * cache_line);
+
+typedef struct journals_if {
+    // bytes of payload history rounded up to power of 2; the index holds
+    // 4 * bytes / frame_bytes frames (variable size frames are mostly smaller)
+    uint64_t (*size)(uint32_t frame_bytes, uint64_t bytes);
+    void (*layout)(volatile shared_journal_t* j, uint32_t frame_bytes, uint64_t bytes);
+    // producer: in sequence order, streams.publish() appends before commit
+    void (*append)(volatile shared_journal_t* j, const void* data, uint32_t bytes,
+                   uint64_t timestamp, uint64_t sequence);
+    // readers: sequences [*first .. *last] are in the journal (first > last
+    // when it is empty); the oldest may be overwritten by the time they are read
+    void (*range)(volatile shared_journal_t* j, uint64_t* first, uint64_t* last);
+    // copies min(info->bytes, capacity) bytes of frame `sequence`;
+    // false if it is not (or no longer) in the journal
+    bool (*read)(volatile shared_journal_t* j, uint64_t sequence, void* data, uint32_t capacity,
+                 frame_info_t* info);
+    // first sequence stamped at or after `ticks` (clocks.ticks()), 0 if none;
+    // concurrent producers stamp frames a little out of sequence order
+    uint64_t (*find)(volatile shared_journal_t* j, uint64_t ticks);
+} journals_if;
+
+extern journals_if journals;
+
+end_c
@@ -0,0 +1,270 @@
+#include "win64s.h"
+#include "kv.h"
+
+begin_c
+
+static uint32_t kv_hash(const char* key) { // FNV-1a, never 0
+    uint32_t h = 2166136261u;
+    while (*key != 0) { h = (h ^ (byte)*key++) * 16777619u; }
+    return h == 0 ? 1 : h;
+}
+
+static volatile shared_kv_t* kv_table(volatile shared_memory_t* sm) {
+    assert(sm->kv != 0);
+    return (volatile shared_kv_t*)((byte*)sm + sm->kv);
+}
+
+static volatile shared_kv_bucket_t* kv_bucket(volatile shared_kv_t* t, uint32_t ix) {
+    return (volatile shared_kv_bucket_t*)((byte*)t + sizeof(shared_kv_t)) + (ix & (t->buckets - 1));
+}
+
+static uint64_t kv_size(uint32_t buckets) {
+    assert(buckets > 1 && (buckets & (buckets - 1)) == 0, "buckets=%d must be power of 2", buckets);
+    return sizeof(shared_kv_t) + (uint64_t)buckets * sizeof(shared_kv_bucket_t);
+}
+
+static void kv_layout(shared_memory_t* sm, uint64_t offset, uint32_t buckets) {
+    assert(offset % 64 == 0 && offset >= sm->bytes);
+    sm->kv = offset;
+    volatile shared_kv_t* t = kv_table(sm);
+    memset((void*)t, 0, kv_size(buckets));
+    t->buckets = buckets;
+    sm->bytes = offset + kv_size(buckets);
+}
+
+// seqlock protected probe; returns bytes, kv_miss or kv_oversize
+static int kv_probe(volatile shared_memory_t* sm, const char* key, uint32_t h,
+                    char* value, uint32_t capacity, blob_t* blob, int* bucket) {
+    volatile shared_kv_t* t = kv_table(sm);
+    const size_t n = strlen(key) + 1;
+    if (n > kv_key_bytes) { return kv_miss; } // cannot be stored
+    for (uint32_t i = 0; i < t->buckets; i++) {
+        volatile shared_kv_bucket_t* b = kv_bucket(t, h + i);
+        for (;;) {
+            const uint32_t end = b->end;
+            fence_acquire(); // end is read before the bucket
+            const uint32_t hash = b->hash;
+            const uint32_t bytes = b->bytes;
+            bool match = hash == h && memcmp((const void*)b->key, key, n) == 0;
+            int r = hash == 0 ? kv_miss : 0;
+            if (match) {
+                if (bytes > kv_value_bytes) {
+                    if (blob != null) { memcpy(blob, (const void*)b->value, sizeof(*blob)); }
+                    r = kv_oversize;
+                } else if (bytes > capacity) {
+                    r = kv_oversize;
+                } else {
+                    memcpy(value, (const void*)b->value, bytes);
+                    r = (int)bytes;
+                }
+            }
+            fence_acquire(); // bucket is read before begin
+            if (b->begin == end) {
+                if (hash == 0 || match) {
+                    *bucket = (int)((h + i) & (t->buckets - 1));
+                    return r;
+                }
+                break; // collision: probe next bucket
+            }
+            spin_pause(); // writer is in the middle of modifying the bucket
+        }
+    }
+    return kv_miss;
+}
+
+static int kv_get(volatile shared_memory_t* sm, const char* key, char* value, uint32_t capacity,
+                  blob_t* blob) {
+    int bucket = -1;
+    return kv_probe(sm, key, kv_hash(key), value, capacity, blob, &bucket);
+}
+
+static int kv_set(volatile shared_memory_t* sm, const char* key, const char* value,
+                  const blob_t* blob, blob_t* previous) {
+    volatile shared_kv_t* t = kv_table(sm);
+    const size_t n = strlen(key) + 1;
+    const size_t bytes = strlen(value) + 1;
+    memset(previous, 0, sizeof(*previous));
+    if (n > kv_key_bytes || bytes > UINT32_MAX) { return kv_too_long; }
+    assert((bytes > kv_value_bytes) == (blob != null));
+    const uint32_t h = kv_hash(key);
+    char v[kv_value_bytes];
+    int bucket = -1;
+    int r = kv_probe(sm, key, h, v, sizeof(v), previous, &bucket);
+    if (r == kv_miss) {
+        // keep one bucket empty so that probe sequences terminate
+        if (t->count >= t->buckets - 1 || bucket < 0) { return kv_full; }
+        t->count++;
+    }
+    if (r != kv_oversize) { memset(previous, 0, sizeof(*previous)); }
+    volatile shared_kv_bucket_t* b = kv_bucket(t, (uint32_t)bucket);
+    const uint32_t sequence = b->begin + 1;
+    b->begin = sequence;
+    fence_release(); // begin is visible before any of the bucket modifications
+    if (r == kv_miss) {
+        memcpy((void*)b->key, key, n);
+        b->hash = h;
+    }
+    b->bytes = (uint32_t)bytes;
+    if (blob != null) {
+        memcpy((void*)b->value, blob, sizeof(*blob));
+    } else {
+        memcpy((void*)b->value, value, bytes);
+    }
+    fence_release(); // bucket is complete before end is visible
+    b->end = sequence;
+    return 0;
+}
+
+kv_if kv = {
+    kv_size,
+    kv_layout,
+    kv_set,
+    kv_get
+};
+
+// Blob arena: descriptors never move, so readers validate a blob_t by
+// its descriptor generation. Free space is tracked by the server only
+// as sorted, coalesced extents.
+
+typedef struct extent_s { uint64_t offset; uint64_t bytes; } extent_t;
+
+static struct {
+    extent_t* free; // sorted by offset
+    int count;
+    int capacity;
+} arena;
+
+#define align64(n) (((n) + 63) & ~(uint64_t)63)
+
+static volatile shared_blobs_t* blobs_table(volatile shared_memory_t* sm) {
+    assert(sm->blobs != 0);
+    return (volatile shared_blobs_t*)((byte*)sm + sm->blobs);
+}
+
+static volatile shared_blob_t* blobs_descriptor(volatile shared_memory_t* sm, uint32_t i) {
+    volatile shared_blobs_t* t = blobs_table(sm);
+    assert(i < t->count);
+    return (volatile shared_blob_t*)((byte*)t + sizeof(shared_blobs_t)) + i;
+}
+
+static uint64_t blobs_size(uint32_t count, uint64_t arena_bytes) {
+    return align64(sizeof(shared_blobs_t) + (uint64_t)count * sizeof(shared_blob_t)) + arena_bytes;
+}
+
+static void blobs_layout(shared_memory_t* sm, uint64_t offset, uint32_t count, uint64_t arena_bytes) {
+    assert(offset % 64 == 0 && offset >= sm->bytes);
+    sm->blobs = offset;
+    volatile shared_blobs_t* t = blobs_table(sm);
+    t->count = count;
+    t->arena = offset + align64(sizeof(shared_blobs_t) + (uint64_t)count * sizeof(shared_blob_t));
+    t->arena_bytes = arena_bytes;
+    for (uint32_t i = 0; i < count; i++) {
+        volatile shared_blob_t* d = blobs_descriptor(sm, i);
+        d->generation = 1; // free
+        d->offset = 0;
+        d->bytes = 0;
+    }
+    sm->bytes = offset + blobs_size(count, arena_bytes);
+    // each allocation splits at most one free extent: count + 1 is enough
+    arena.capacity = (int)count + 1;
+    fatal_if_null(arena.free = (extent_t*)heap.alloc(arena.capacity * sizeof(extent_t)));
+    arena.free[0].offset = t->arena;
+    arena.free[0].bytes = arena_bytes;
+    arena.count = 1;
+}
+
+static uint64_t arena_allocate(uint64_t bytes) { // first fit, 0 if no space
+    const uint64_t n = align64(bytes);
+    for (int i = 0; i < arena.count; i++) {
+        extent_t* e = &arena.free[i];
+        if (e->bytes >= n) {
+            const uint64_t offset = e->offset;
+            e->offset += n;
+            e->bytes -= n;
+            if (e->bytes == 0) {
+                memmove(e, e + 1, (arena.count - i - 1) * sizeof(extent_t));
+                arena.count--;
+            }
+            return offset;
+        }
+    }
+    return 0;
+}
+
+static void arena_free(uint64_t offset, uint64_t bytes) {
+    const uint64_t n = align64(bytes);
+    int i = 0;
+    while (i < arena.count && arena.free[i].offset < offset) { i++; }
+    extent_t* prev = i > 0 ? &arena.free[i - 1] : null;
+    extent_t* next = i < arena.count ? &arena.free[i] : null;
+    const bool join_prev = prev != null && prev->offset + prev->bytes == offset;
+    const bool join_next = next != null && offset + n == next->offset;
+    if (join_prev && join_next) {
+        prev->bytes += n + next->bytes;
+        memmove(next, next + 1, (arena.count - i - 1) * sizeof(extent_t));
+        arena.count--;
+    } else if (join_prev) {
+        prev->bytes += n;
+    } else if (join_next) {
+        next->offset = offset;
+        next->bytes += n;
+    } else {
+        assert(arena.count < arena.capacity);
+        memmove(&arena.free[i + 1], &arena.free[i], (arena.count - i) * sizeof(extent_t));
+        arena.free[i].offset = offset;
+        arena.free[i].bytes = n;
+        arena.count++;
+    }
+}
+
+static int blobs_put(volatile shared_memory_t* sm, const void* data, uint64_t bytes, blob_t* blob) {
+    volatile shared_blobs_t* t = blobs_table(sm);
+    memset(blob, 0, sizeof(*blob));
+    uint32_t i = 0;
+    while (i < t->count && (blobs_descriptor(sm, i)->generation & 1) == 0) { i++; }
+    const uint64_t offset = i < t->count ? arena_allocate(bytes) : 0;
+    if (offset == 0) { return kv_full; }
+    volatile shared_blob_t* d = blobs_descriptor(sm, i);
+    memcpy((byte*)sm + offset, data, bytes);
+    d->offset = offset;
+    d->bytes = bytes;
+    fence_release(); // value is complete before it is published
+    d->generation++;
+    blob->offset = offset;
+    blob->bytes = bytes;
+    blob->generation = d->generation;
+    blob->index = i;
+    return 0;
+}
+
+static void blobs_release(volatile shared_memory_t* sm, const blob_t* blob) {
+    volatile shared_blob_t* d = blobs_descriptor(sm, blob->index);
+    assert(d->generation == blob->generation && d->offset == blob->offset);
+    d->generation++; // readers of the value in place will see it invalidated
+    fence_release(); // before the space can be reused and overwritten
+    arena_free(d->offset, d->bytes);
+}
+
+static const void* blobs_data(volatile shared_memory_t* sm, const blob_t* blob) {
+    volatile shared_blobs_t* t = blobs_table(sm);
+    if (blob->index >= t->count) { return null; }
+    const uint32_t g = blobs_descriptor(sm, blob->index)->generation;
+    fence_acquire(); // generation is read before the value
+    return g == blob->generation ? (const void*)((byte*)sm + blob->offset) : null;
+}
+
+static bool blobs_valid(volatile shared_memory_t* sm, const blob_t* blob) {
+    fence_acquire(); // value is read before the generation
+    return blobs_descriptor(sm, blob->index)->generation == blob->generation;
+}
+
+blobs_if blobs = {
+    blobs_size,
+    blobs_layout,
+    blobs_put,
+    blobs_release,
+    blobs_data,
+    blobs_valid
+};
+
+end_c
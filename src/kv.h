@@ -0,0 +1,98 @@
+#pragma once
+#include "win64s.h"
+#include "server.h"
+
+begin_c
+
+// Open addressed (linear probing) key/value table in shared memory.
+// Server is the only writer (under its lock); clients read buckets
+// directly from their mapping without any RPC. Each bucket is seqlock
+// protected the same way as shared_frame_t. Keys are never removed,
+// so an empty bucket terminates the probe sequence.
+// Values that do not fit into a bucket are placed into the blob arena
+// and the bucket holds blob_t handle to them instead.
+
+enum {
+    kv_buckets     = 1024, // power of 2
+    kv_key_bytes   = 48,   // including zero terminator
+    kv_value_bytes = 192,  // inline capacity including zero terminator
+    kv_miss        = -1,   // kv.get() results
+    kv_oversize    = -2,
+    kv_too_long    = -3,   // kv.set() results
+    kv_full        = -4,
+    blob_arena_bytes = 16 * 1024 * 1024
+};
+
+typedef struct blob_s { // handle of a value in the blob arena
+    uint64_t offset;     // of the value from the start of shared_memory_t
+    uint64_t bytes;      // including zero terminator for string values
+    uint32_t generation; // of the descriptor when value was placed
+    uint32_t index;      // of the shared_blob_t descriptor
+} blob_t;
+
+typedef struct shared_kv_bucket_s { // 256 bytes
+    volatile uint32_t begin; // writer incremented before modifying bucket
+    volatile uint32_t end;   // writer sets to begin when bucket is complete
+    uint32_t hash;           // 0 for empty bucket, never changes once set
+    uint32_t bytes;          // value bytes including zero terminator, > kv_value_bytes: oversize
+    char key[kv_key_bytes];
+    char value[kv_value_bytes]; // blob_t for oversize values
+} shared_kv_bucket_t;
+
+typedef struct shared_kv_s {
+    uint32_t buckets; // power of 2
+    uint32_t count;   // number of used buckets (written by server)
+    uint64_t reserved;
+    // followed by shared_kv_bucket_t[buckets]
+} shared_kv_t;
+
+typedef struct shared_blob_s {
+    volatile uint32_t generation; // even: value is published, odd: free or being replaced
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t bytes;
+} shared_blob_t;
+
+typedef struct shared_blobs_s {
+    uint32_t count;       // number of shared_blob_t descriptors
+    uint32_t reserved;
+    uint64_t arena;       // offset of the arena from the start of shared_memory_t
+    uint64_t arena_bytes;
+    // followed by shared_blob_t[count]
+} shared_blobs_t;
+
+typedef struct kv_if {
+    uint64_t (*size)(uint32_t buckets);
+    // lays out the table at offset from the start of sm and extends sm->bytes
+    void (*layout)(shared_memory_t* sm, uint64_t offset, uint32_t buckets);
+    // writer: value that does not fit into the bucket must be placed into the
+    // blob arena by the caller and described by blob (otherwise blob is null).
+    // Returns 0, kv_too_long when key does not fit or kv_full. *previous
+    // receives the replaced blob (previous->bytes == 0 if none) to release.
+    int (*set)(volatile shared_memory_t* sm, const char* key, const char* value,
+               const blob_t* blob, blob_t* previous);
+    // lock free reader: returns number of bytes copied into value (including
+    // zero terminator), kv_miss or kv_oversize when value does not fit into
+    // bucket inline storage or capacity. Oversize values fill *blob when
+    // blob is not null.
+    int (*get)(volatile shared_memory_t* sm, const char* key, char* value, uint32_t capacity,
+               blob_t* blob);
+} kv_if;
+
+extern kv_if kv;
+
+typedef struct blobs_if {
+    uint64_t (*size)(uint32_t count, uint64_t arena_bytes);
+    void (*layout)(shared_memory_t* sm, uint64_t offset, uint32_t count, uint64_t arena_bytes);
+    // writer: copies data into the arena, 0 or kv_full if there is no space
+    int (*put)(volatile shared_memory_t* sm, const void* data, uint64_t bytes, blob_t* blob);
+    void (*release)(volatile shared_memory_t* sm, const blob_t* blob);
+    // lock free readers: data() returns pointer to the value in place or null
+    // if it has been released; the value read is consistent if valid() after
+    const void* (*data)(volatile shared_memory_t* sm, const blob_t* blob);
+    bool (*valid)(volatile shared_memory_t* sm, const blob_t* blob);
+} blobs_if;
+
+extern blobs_if blobs;
+
+end_c
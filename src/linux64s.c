@@ -0,0 +1,628 @@
+#define _GNU_SOURCE // ppoll(), memfd_create(), PTHREAD_MUTEX_ADAPTIVE_NP
+#include "win64s.h"
+#ifdef __linux__
+#include <limits.h>
+#include <poll.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+#include <linux/futex.h>
+#include <linux/mempolicy.h>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+begin_c
+
+// Linux implementation of win64s.h interfaces.
+// handle_t points to a heap allocated object that starts with handle_header_t.
+// Events are futex words with an eventfd "doorbell" that is only rung when
+// somebody poll()s on the event (wait_any) or when the event has been shared
+// with another process (file descriptor passing) in which case the eventfd
+// counter itself is the event state.
+
+enum {
+    handle_kind_event  = 0x45564E54, // 'EVNT'
+    handle_kind_thread = 0x54485244, // 'THRD'
+    handle_kind_file   = 0x46494C45, // 'FILE' any other file descriptor
+    events_spin_count  = 256 // spin_pause() iterations before blocking
+};
+
+typedef struct handle_header_s {
+    int32_t kind;
+    volatile int32_t refs; // handles.dup() inside the process shares the object
+    int fd; // -1 for threads
+} handle_header_t;
+
+typedef struct event_s {
+    handle_header_t h;        // h.fd is eventfd
+    volatile int32_t state;   // futex word: 1 signaled, 0 non-signaled
+    volatile int32_t waiters; // number of threads blocked in futex wait
+    volatile int32_t pollers; // number of threads blocked in poll() on h.fd
+    bool manual;
+    bool shared;              // h.fd crossed process boundary: state is h.fd counter
+} event_t;
+
+typedef struct thread_handle_s {
+    handle_header_t h;
+    pthread_t pthread;
+    uint32_t (*proc)(void* thread);
+    thread_t* thread;
+} thread_handle_t;
+
+static void vtraceln(const char* file, int line, const char* function, const char* format, va_list vl) {
+    char s[2048];
+    s[0] = 0;
+    char* sb = s;
+    int left = sizeof(s) - 1;
+    if (file != null && line >= 0) {
+        int n = snprintf(sb, left, "%s(%d): [%05d] %s ", file, line, (int)syscall(SYS_gettid), function);
+        sb += n;
+        left -= n;
+    }
+    int k = vsnprintf(sb, left, format, vl);
+    sb += k;
+    if (sb[-1] != '\n') {
+        *sb = '\n';
+        sb++;
+        *sb = 0;
+    }
+    fprintf(stderr, "%s", s);
+}
+
+void traceline(const char* file, int line, const char* function, const char* format, ...) {
+    va_list vl;
+    va_start(vl, format);
+    vtraceln(file, line, function, format, vl);
+    va_end(vl);
+}
+
+static const char* assertion_failed_filename(const char* file) {
+    char* fn = strrchr(file, '/');
+    return fn != null ? fn + 1 : file;
+}
+
+void assertion_failed(const char* file, int line, const char* function,
+                      const char* condition, const char* format, ...) {
+    const char* fn = assertion_failed_filename(file);
+    const int n = (int)strlen(format);
+    traceline(fn, line, function, "assertion failed: \"%s\"", condition);
+    if (n > 0) {
+        va_list va;
+        va_start(va, format);
+        vtraceln(fn, line, function, format, va);
+        va_end(va);
+    }
+    exit(1);
+}
+
+static void* allocate(uint64_t bytes) { return malloc((size_t)bytes); }
+
+static void deallocate(void* p) { free(p); }
+
+heap_i heap = { allocate, deallocate };
+
+uint64_t nanoseconds_since_boot() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (uint64_t)ts.tv_sec * 1000 * 1000 * 1000 + (uint64_t)ts.tv_nsec;
+}
+
+bool cycles_invariant() {
+#if defined(__x86_64__) || defined(__i386__)
+    uint32_t eax = 0, ebx = 0, ecx = 0, edx = 0;
+    if (__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) == 0 || eax < 0x80000007) { return false; }
+    __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+    return (edx & (1u << 8)) != 0; // invariant TSC
+#elif defined(__aarch64__)
+    return true; // generic timer virtual counter
+#else
+    return false;
+#endif
+}
+
+double seconds_since_boot() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts); // not subject to NTP slewing
+    return (double)ts.tv_sec + ts.tv_nsec * 1.0e-9;
+}
+
+void sleep(double seconds) {
+    assert(seconds >= 0);
+    if (seconds < 0) { seconds = 0; }
+    struct timespec ts;
+    ts.tv_sec = (time_t)seconds;
+    ts.tv_nsec = (long)((seconds - (double)ts.tv_sec) * 1.0e+9);
+    // clock_nanosleep() does not accept CLOCK_MONOTONIC_RAW
+    while (clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, &ts) == EINTR) { }
+}
+
+const char* timestamp_string() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    static char thread_local text[128];
+    int64_t us = (int64_t)ts.tv_sec * 1000 * 1000 + ts.tv_nsec / 1000; // microseconds
+    int64_t s = (int64_t)(us / (1000 * 1000)); // seconds
+    snprintf(text, countof(text) - 1, "%02d:%02d.%03d:%03d",
+        (int)(s / 60) % 60, (int)(s % 60), (int)(us / 1000) % 1000, (int)(us % 1000));
+    return text;
+}
+
+void fatal_windows_error(const char* file, int line, const char* function,
+                         uint32_t error, const char* call, const char* extra) {
+    traceline(file, line, function, "%s failed %s %s", call, error_to_string(error), extra);
+    exit(1);
+}
+
+const char* error_to_string(uint32_t e) {
+    static char thread_local m[1024];
+    snprintf(m, sizeof(m) - 1, "0x%08X(%d) \"%s\"", e, e, strerror((int)e));
+    return m;
+}
+
+const char* last_error() { return error_to_string(errno); }
+
+void posix_soft_realtime_thread() {
+    struct sched_param sp = { 0 };
+    sp.sched_priority = sched_get_priority_max(SCHED_FIFO) - 1;
+    // unprivileged processes get EPERM and keep SCHED_OTHER
+    (void)pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp);
+}
+
+static int futex(volatile int32_t* address, int op, int32_t value, const struct timespec* timeout) {
+    return (int)syscall(SYS_futex, address, op, value, timeout, null, 0);
+}
+
+// returns false if deadline has already passed
+static bool time_remaining(double deadline, struct timespec* ts) {
+    double seconds = deadline - seconds_since_boot();
+    if (seconds <= 0) { return false; }
+    ts->tv_sec = (time_t)seconds;
+    ts->tv_nsec = (long)((seconds - (double)ts->tv_sec) * 1.0e+9);
+    return true;
+}
+
+static handle_header_t* header_of(handle_t h) {
+    handle_header_t* hh = (handle_header_t*)h;
+    assert(hh != null && hh->refs > 0);
+    return hh;
+}
+
+static void handles_close(handle_t handle) {
+    handle_header_t* hh = header_of(handle);
+    if (__atomic_sub_fetch(&hh->refs, 1, __ATOMIC_SEQ_CST) == 0) {
+        if (hh->kind == handle_kind_thread) {
+            fatal_if_not_zero(pthread_detach(((thread_handle_t*)hh)->pthread));
+        }
+        if (hh->fd >= 0) { fatal_if_false(close(hh->fd) == 0); }
+        hh->kind = 0;
+        heap.free(hh);
+    }
+}
+
+static handle_t handles_dup(handle_t s, handle_t process_from, handle_t process_to) {
+    // there is no DuplicateHandle() into another process on Linux:
+    // file descriptors cross process boundary via SCM_RIGHTS (see uds.c)
+    assert(process_from == process_to, "process_from=%p process_to=%p", process_from, process_to);
+    handle_header_t* hh = header_of(s);
+    __atomic_add_fetch(&hh->refs, 1, __ATOMIC_SEQ_CST);
+    return s;
+}
+
+static bool handles_is_valid(handle_t h) {
+    handle_header_t* hh = (handle_header_t*)h;
+    return hh != null && hh->refs > 0 && (hh->kind == handle_kind_event ||
+        hh->kind == handle_kind_thread || hh->kind == handle_kind_file);
+}
+
+handles_if handles = {
+    handles_is_valid,
+    handles_dup,
+    handles_close
+};
+
+static event_t* event_of(handle_t h) {
+    event_t* e = (event_t*)header_of(h);
+    assert(e->h.kind == handle_kind_event);
+    return e;
+}
+
+static handle_t events_create_event(bool manual) {
+    event_t* e = null;
+    fatal_if_null(e = (event_t*)heap.alloc(sizeof(event_t)));
+    memset(e, 0, sizeof(*e));
+    e->h.kind = handle_kind_event;
+    e->h.refs = 1;
+    e->manual = manual;
+    fatal_if_false((e->h.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) >= 0);
+    return e;
+}
+
+static handle_t events_create() { return events_create_event(false); }
+
+static handle_t events_create_manual() { return events_create_event(true); }
+
+static void events_ring(event_t* e) {
+    uint64_t one = 1;
+    fatal_if_false(write(e->h.fd, &one, sizeof(one)) == sizeof(one));
+}
+
+static void events_drain(event_t* e) {
+    uint64_t count = 0;
+    ssize_t k = read(e->h.fd, &count, sizeof(count));
+    fatal_if_false(k == sizeof(count) || errno == EAGAIN);
+}
+
+static bool events_try(event_t* e) { // consumes auto-reset signal
+    if (e->shared && e->manual) {
+        struct pollfd pfd = { e->h.fd, POLLIN, 0 };
+        return poll(&pfd, 1, 0) == 1;
+    } else if (e->shared) {
+        uint64_t count = 0;
+        return read(e->h.fd, &count, sizeof(count)) == sizeof(count);
+    } else if (e->manual) {
+        return __atomic_load_n(&e->state, __ATOMIC_ACQUIRE) == 1;
+    } else {
+        int32_t signaled = 1;
+        return __atomic_compare_exchange_n(&e->state, &signaled, 0, false,
+            __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+    }
+}
+
+static void events_set(handle_t h) {
+    event_t* e = event_of(h);
+    if (e->shared) {
+        events_ring(e);
+    } else {
+        __atomic_store_n(&e->state, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&e->waiters, __ATOMIC_SEQ_CST) > 0) {
+            futex(&e->state, FUTEX_WAKE_PRIVATE, e->manual ? INT_MAX : 1, null);
+        }
+        if (__atomic_load_n(&e->pollers, __ATOMIC_SEQ_CST) > 0) { events_ring(e); }
+    }
+}
+
+static void events_reset(handle_t h) {
+    event_t* e = event_of(h);
+    __atomic_store_n(&e->state, 0, __ATOMIC_SEQ_CST);
+    if (e->shared) { events_drain(e); }
+}
+
+static int events_wait_any_or_timeout(int n, handle_t handles[], uint32_t ms) {
+    enum { max_events = 64 }; // same as MAXIMUM_WAIT_OBJECTS
+    assert(0 < n && n <= max_events);
+    event_t* e[max_events];
+    struct pollfd fds[max_events];
+    bool spin = ms != 0;
+    for (int i = 0; i < n; i++) {
+        e[i] = event_of(handles[i]);
+        fds[i].fd = e[i]->h.fd;
+        fds[i].events = POLLIN;
+        fds[i].revents = 0;
+        spin = spin && !e[i]->shared; // shared events cost a syscall to check
+    }
+    int r = -1;
+    for (int k = 0; spin && k < events_spin_count && r < 0; k++) {
+        for (int i = 0; i < n && r < 0; i++) { if (events_try(e[i])) { r = i; } }
+        if (r < 0) { spin_pause(); }
+    }
+    if (r < 0) {
+        for (int i = 0; i < n; i++) { __atomic_add_fetch(&e[i]->pollers, 1, __ATOMIC_SEQ_CST); }
+        const double deadline = seconds_since_boot() + ms / 1000.0;
+        for (;;) {
+            for (int i = 0; i < n && r < 0; i++) { if (events_try(e[i])) { r = i; } }
+            struct timespec ts;
+            if (r >= 0 || (ms != forever && !time_remaining(deadline, &ts))) { break; }
+            int k = ppoll(fds, n, ms == forever ? null : &ts, null);
+            fatal_if_false(k >= 0 || errno == EINTR);
+            for (int i = 0; i < n && k > 0; i++) {
+                // set() rings the doorbell after changing state
+                if (!e[i]->shared && (fds[i].revents & POLLIN) != 0) { events_drain(e[i]); }
+            }
+        }
+        for (int i = 0; i < n; i++) { __atomic_sub_fetch(&e[i]->pollers, 1, __ATOMIC_SEQ_CST); }
+    }
+    return r;
+}
+
+static int events_wait_any(int n, handle_t e[]) {
+    return events_wait_any_or_timeout(n, e, forever);
+}
+
+static int events_wait_or_timeout(handle_t h, uint32_t ms) {
+    event_t* e = event_of(h);
+    if (e->shared) { return events_wait_any_or_timeout(1, &h, ms); }
+    int r = -1;
+    const int spins = ms == 0 ? 1 : events_spin_count;
+    for (int k = 0; k < spins && r < 0; k++) {
+        if (events_try(e)) { r = 0; } else { spin_pause(); }
+    }
+    if (r < 0 && ms != 0) {
+        __atomic_add_fetch(&e->waiters, 1, __ATOMIC_SEQ_CST);
+        const double deadline = seconds_since_boot() + ms / 1000.0;
+        for (;;) {
+            if (events_try(e)) { r = 0; }
+            struct timespec ts;
+            if (r == 0 || (ms != forever && !time_remaining(deadline, &ts))) { break; }
+            int k = futex(&e->state, FUTEX_WAIT_PRIVATE, 0, ms == forever ? null : &ts);
+            fatal_if_false(k == 0 || errno == EAGAIN || errno == EINTR || errno == ETIMEDOUT);
+        }
+        __atomic_sub_fetch(&e->waiters, 1, __ATOMIC_SEQ_CST);
+    }
+    return r;
+}
+
+static void events_wait(handle_t e) { events_wait_or_timeout(e, forever); }
+
+events_if events = {
+    events_create,
+    events_create_manual,
+    events_set,
+    events_reset,
+    events_wait,
+    events_wait_or_timeout,
+    events_wait_any,
+    events_wait_any_or_timeout,
+    handles_close
+};
+
+static void* threads_start(void* p) {
+    thread_handle_t* th = (thread_handle_t*)p;
+    th->proc(th->thread);
+    return null;
+}
+
+static void threads_create_with_event(thread_t* thread, uint32_t (WINAPI *proc)(void* thread), void* that, handle_t e) {
+    assert(thread->events[0] == null);
+    assert(thread->events[1] == null);
+    assert(thread->thread == null);
+    assert(thread->that == null);
+    thread->that = that;
+    thread->events[0] = events.create();
+    fatal_if_null(thread->events[1] = e);
+    thread_handle_t* th = null;
+    fatal_if_null(th = (thread_handle_t*)heap.alloc(sizeof(thread_handle_t)));
+    memset(th, 0, sizeof(*th));
+    th->h.kind = handle_kind_thread;
+    th->h.refs = 1;
+    th->h.fd = -1;
+    th->proc = proc;
+    th->thread = thread;
+    thread->thread = th;
+    fatal_if_not_zero(pthread_create(&th->pthread, null, threads_start, th));
+}
+
+static void threads_create(thread_t* thread, uint32_t (WINAPI *proc)(void* thread), void* that) {
+    threads_create_with_event(thread, proc, that, events.create());
+}
+
+static void threads_join(thread_t* thread) {
+    events.set(thread->events[0]);
+    thread_handle_t* th = (thread_handle_t*)header_of(thread->thread);
+    assert(th->h.kind == handle_kind_thread);
+    fatal_if_not_zero(pthread_join(th->pthread, null));
+    events.dispose(thread->events[0]);
+    events.dispose(thread->events[1]);
+    th->h.kind = 0;
+    heap.free(th);
+    memset(thread, 0, sizeof(*thread));
+}
+
+static void threads_notify(thread_t* thread) {
+    events.set(thread->events[1]);
+}
+
+threads_if threads = {
+    threads_create_with_event,
+    threads_create,
+    threads_notify,
+    threads_join
+};
+
+static void mutexes_init(mutex_t* m) {
+    pthread_mutexattr_t a;
+    fatal_if_not_zero(pthread_mutexattr_init(&a));
+    fatal_if_not_zero(pthread_mutexattr_settype(&a, PTHREAD_MUTEX_ADAPTIVE_NP));
+    fatal_if_not_zero(pthread_mutex_init(m, &a));
+    fatal_if_not_zero(pthread_mutexattr_destroy(&a));
+}
+
+static void mutexes_lock(mutex_t* m) { fatal_if_not_zero(pthread_mutex_lock(m)); }
+
+static bool mutexes_try_lock(mutex_t* m) {
+    int r = pthread_mutex_trylock(m);
+    fatal_if_false(r == 0 || r == EBUSY);
+    return r == 0;
+}
+
+static void mutexes_unlock(mutex_t* m) { fatal_if_not_zero(pthread_mutex_unlock(m)); }
+
+static void mutexes_dispose(mutex_t* m) { fatal_if_not_zero(pthread_mutex_destroy(m)); }
+
+mutexes_if mutexes = {
+    mutexes_init,
+    mutexes_lock,
+    mutexes_try_lock,
+    mutexes_unlock,
+    mutexes_dispose
+};
+
+handle_t posix_handle_import(int fd, bool event) {
+    handle_t h = null;
+    if (event) {
+        h = events_create();
+        event_t* e = event_of(h);
+        fatal_if_false(close(e->h.fd) == 0);
+        e->h.fd = fd;
+        e->shared = true;
+    } else {
+        handle_header_t* hh = null;
+        fatal_if_null(hh = (handle_header_t*)heap.alloc(sizeof(handle_header_t)));
+        hh->kind = handle_kind_file;
+        hh->refs = 1;
+        hh->fd = fd;
+        h = hh;
+    }
+    return h;
+}
+
+int posix_handle_export(handle_t h) {
+    handle_header_t* hh = header_of(h);
+    assert(hh->kind == handle_kind_event || hh->kind == handle_kind_file);
+    if (hh->kind == handle_kind_event) {
+        event_t* e = (event_t*)hh;
+        if (!e->shared) {
+            e->shared = true;
+            if (__atomic_exchange_n(&e->state, 0, __ATOMIC_SEQ_CST) != 0) { events_ring(e); }
+        }
+    }
+    return hh->fd;
+}
+
+static handle_t mappings_create(uint64_t bytes) {
+    int fd = -1;
+    fatal_if_false((fd = memfd_create("rpc", MFD_CLOEXEC)) >= 0);
+    fatal_if_false(ftruncate(fd, (off_t)bytes) == 0, "bytes=%lld", (long long)bytes);
+    return posix_handle_import(fd, false);
+}
+
+static uint64_t mappings_large_page_size() {
+    unsigned long long kb = 0;
+    FILE* f = fopen("/proc/meminfo", "r");
+    char line[128];
+    while (f != null && kb == 0 && fgets(line, sizeof(line), f) != null) {
+        if (sscanf(line, "Hugepagesize: %llu kB", &kb) != 1) { kb = 0; }
+    }
+    if (f != null) { fclose(f); }
+    return kb * 1024;
+}
+
+static void mappings_touch(void* address, uint64_t bytes) {
+    for (uint64_t i = 0; i < bytes; i += 4096) { (void)((volatile byte*)address)[i]; }
+}
+
+static handle_t mappings_create_placed(uint64_t bytes, bool large, int node) {
+    int fd = -1;
+    if ((fd = memfd_create("rpc", MFD_CLOEXEC | (large ? MFD_HUGETLB : 0))) < 0) { return null; }
+    fatal_if_false(ftruncate(fd, (off_t)bytes) == 0, "bytes=%lld", (long long)bytes);
+    // hugetlb pages are reserved by mmap(): fails here instead of SIGBUS on touch
+    void* address = mmap(null, (size_t)bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    bool placed = address != MAP_FAILED;
+    if (placed && node >= 0) {
+        unsigned long mask[16] = { 0 }; // up to 1023 nodes
+        placed = node < (int)(sizeof(mask) * 8 - 1);
+        if (placed) {
+            mask[node / (sizeof(long) * 8)] = 1UL << (node % (sizeof(long) * 8));
+            placed = syscall(SYS_mbind, address, (unsigned long)bytes, MPOL_BIND, mask,
+                             (unsigned long)(sizeof(mask) * 8), 0) == 0;
+        }
+        // allocate the pages now: they stay on the node for the lifetime of memfd
+        for (uint64_t i = 0; placed && i < bytes; i += 4096) { ((volatile byte*)address)[i] = 0; }
+    }
+    if (address != MAP_FAILED) { munmap(address, (size_t)bytes); }
+    if (!placed) { close(fd); }
+    return placed ? posix_handle_import(fd, false) : null;
+}
+
+static bool mappings_lock(void* address, uint64_t bytes) {
+    // faults pages in as well; past RLIMIT_MEMLOCK (or without
+    // CAP_IPC_LOCK) pages are only faulted in
+    const bool locked = mlock(address, (size_t)bytes) == 0;
+    if (!locked) { mappings_touch(address, bytes); }
+    return locked;
+}
+
+static void* mappings_map(handle_t mapping, uint64_t bytes, bool writable) {
+    handle_header_t* hh = header_of(mapping);
+    assert(hh->kind == handle_kind_file);
+    void* address = mmap(null, (size_t)bytes, PROT_READ | (writable ? PROT_WRITE : 0),
+        MAP_SHARED, hh->fd, 0);
+    fatal_if_false(address != MAP_FAILED, "bytes=%lld", (long long)bytes);
+    return address;
+}
+
+static void mappings_unmap(void* address, uint64_t bytes) {
+    fatal_if_false(munmap(address, (size_t)bytes) == 0);
+}
+
+static handle_t mappings_file(const char* filename, uint64_t* bytes, bool writable) {
+    int fd = open(filename, writable ? O_RDWR | O_CREAT | O_CLOEXEC : O_RDONLY | O_CLOEXEC, 0644);
+    if (fd < 0) { return null; }
+    struct stat st;
+    const bool ok = writable ? ftruncate(fd, (off_t)*bytes) == 0 : fstat(fd, &st) == 0;
+    if (!ok) { close(fd); return null; }
+    if (!writable) { *bytes = (uint64_t)st.st_size; }
+    return posix_handle_import(fd, false);
+}
+
+mappings_if mappings = {
+    mappings_create,
+    mappings_create_placed,
+    mappings_map,
+    mappings_unmap,
+    mappings_large_page_size,
+    mappings_lock,
+    mappings_file
+};
+
+static void broadcasts_init(broadcast_t* b, broadcast_shared_t* shared, handle_t parity[2]) {
+    memset(b, 0, sizeof(*b)); // parity events are not needed: futex works across processes
+    b->shared = shared;
+}
+
+static int32_t broadcasts_publish(broadcast_t* b) {
+    const int32_t g = __atomic_add_fetch(&b->shared->generation, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&b->shared->waiters, __ATOMIC_SEQ_CST) > 0) {
+        futex(&b->shared->generation, FUTEX_WAKE, INT_MAX, null); // not _PRIVATE
+    }
+    return g;
+}
+
+static bool broadcasts_wait(broadcast_t* b, int32_t* seen, uint32_t ms) {
+    __atomic_add_fetch(&b->waiting, 1, __ATOMIC_SEQ_CST);
+    int32_t g = __atomic_load_n(&b->shared->generation, __ATOMIC_ACQUIRE);
+    if (g == *seen && !__atomic_load_n(&b->interrupted, __ATOMIC_SEQ_CST)) {
+        struct timespec ts = { ms / 1000, (ms % 1000) * 1000L * 1000L };
+        __atomic_add_fetch(&b->shared->waiters, 1, __ATOMIC_SEQ_CST);
+        int k = futex(&b->shared->generation, FUTEX_WAIT, *seen, ms == forever ? null : &ts);
+        fatal_if_false(k == 0 || errno == EAGAIN || errno == EINTR || errno == ETIMEDOUT);
+        __atomic_sub_fetch(&b->shared->waiters, 1, __ATOMIC_SEQ_CST);
+        g = __atomic_load_n(&b->shared->generation, __ATOMIC_ACQUIRE);
+    }
+    __atomic_sub_fetch(&b->waiting, 1, __ATOMIC_SEQ_CST);
+    const bool advanced = g != *seen;
+    *seen = g;
+    return advanced;
+}
+
+static void broadcasts_interrupt(broadcast_t* b) {
+    __atomic_store_n(&b->interrupted, true, __ATOMIC_SEQ_CST);
+    // waiter may have checked `interrupted` but not yet entered futex wait:
+    // keep waking until it leaves. Waiters of other processes wake up
+    // spuriously and go back to wait.
+    while (__atomic_load_n(&b->waiting, __ATOMIC_SEQ_CST) > 0) {
+        futex(&b->shared->generation, FUTEX_WAKE, INT_MAX, null);
+        sleep(0.001);
+    }
+}
+
+static void broadcasts_dispose(broadcast_t* b) {
+    memset(b, 0, sizeof(*b));
+}
+
+broadcasts_if broadcasts = {
+    broadcasts_init,
+    broadcasts_publish,
+    broadcasts_wait,
+    broadcasts_interrupt,
+    broadcasts_dispose
+};
+
+end_c
+
+#endif // __linux__
@@ -1,21 +1,20 @@
 #include "win64s.h"
 #include "server.h"
 #include "client.h"
+#include "bench.h"
+#include "stats.h"
+#include "recording.h"
 
 bool verbose; // very global
 
-static bool option(int argc, const char* argv[], const char* name) {
-    for (int i = 0; i < argc; i++) {
-        if (strcmp(argv[i], name) == 0) { return true; }
-    }
-    return false;
-}
-
 int main(int argc, const char* argv[]) {
     int r = 0;
     bool shutdown_when_done = option(argc, argv, "--shutdown");
     verbose = option(argc, argv, "--verbose") || option(argc, argv, "-v");
-    if (argc > 1 && strstr(argv[1], "server") != null) {
+    r = server.configure(argc, argv); // client may run server in process
+    if (r != 0) {
+        // error has been traced
+    } else if (argc > 1 && strstr(argv[1], "server") != null) {
         r = server.main(argc, argv);
     } else if (argc > 1 && strstr(argv[1], "client") != null) {
         r = client.connect();
@@ -27,8 +26,35 @@ int main(int argc, const char* argv[]) {
                 r = client.disconnect();
             }
         }
+    } else if (argc > 1 && strstr(argv[1], "bench") != null) {
+        r = client.connect();
+        if (r == 0) {
+            r = bench.main(argc, argv);
+            if (shutdown_when_done) {
+                client.shutdown();
+            } else {
+                int d = client.disconnect();
+                r = r != 0 ? r : d;
+            }
+        }
+    } else if (argc > 1 && strstr(argv[1], "record") != null) {
+        r = client.connect();
+        if (r == 0) {
+            r = recordings.record(argc, argv);
+            int d = client.disconnect();
+            r = r != 0 ? r : d;
+        }
+    } else if (argc > 1 && strstr(argv[1], "stats") != null) {
+        r = stats.main(argc, argv); // attaches read only, does not connect
     } else {
-        traceln("rpc server|client [--shutdown] [-v] [--verbose]");
+        traceln("rpc server|client|bench|stats|record [--shutdown] [-v] [--verbose] "
+                "[--wait block|hybrid|poll|all] [--spin microseconds] "
+                "[--stream name:frame_bytes:depth:rate[:journal_MB]]... [--journal MB] [--memory-file path] [--workers n] [--clients n] [--stress threads] [--lossless frames] [--sessions n] [--backpressure] "
+                "[--large-pages] [--lock-memory] [--numa node] "
+                "[--iterations n] [--warmup n] [--payload bytes,...] [--frames n] "
+                "[--subscribers n,...] [--waiters n] [--producers n] [--json file] [--csv file] "
+                "[--interval milliseconds] [--count n] "
+                "[--file path] [--streams name,...] [--seconds s] [--segment MB] [--replay path] [--speed x]");
         r = 1;
     }
     if (r != 0) {
@@ -0,0 +1,273 @@
+#include "win64s.h"
+#include "recording.h"
+#include "client.h"
+
+begin_c
+
+static struct {
+    handle_t notification;
+    const char* path;
+    uint64_t segment_bytes;
+    recording_header_t header;
+    int segment;      // index of the open segment
+    handle_t mapping;
+    byte* base;
+    uint64_t offset;  // of the next record in the open segment
+    uint64_t written; // bytes of closed segments
+    // one frame of each stream read ahead: records are written in
+    // timestamp order across streams, so replay never runs backwards
+    byte* staged[max_streams]; // recording_frame_t and payload
+    bool full[max_streams];
+} rec;
+
+static uint64_t record_bytes(uint32_t bytes) { // header and padded payload
+    return sizeof(recording_frame_t) + ((uint64_t)bytes + 7) / 8 * 8;
+}
+
+static void segment_name(char* name, int count, const char* path, int segment) {
+    snprintf(name, count, "%s.%04d", path, segment);
+}
+
+static int segment_create() {
+    char name[300];
+    segment_name(name, countof(name), rec.path, rec.segment);
+    uint64_t bytes = rec.segment_bytes;
+    rec.mapping = mappings.file(name, &bytes, true);
+    if (rec.mapping == null) {
+        const int r = (int)last_error_code();
+        traceln("cannot create %s: %s", name, last_error());
+        return r;
+    }
+    rec.base = (byte*)mappings.map(rec.mapping, rec.segment_bytes, true);
+    rec.header.segment = rec.segment;
+    memcpy(rec.base, &rec.header, sizeof(rec.header));
+    rec.offset = sizeof(recording_header_t);
+    memset(rec.base + rec.offset, 0, sizeof(recording_frame_t)); // end of segment
+    return 0;
+}
+
+static void segment_close() {
+    char name[300];
+    segment_name(name, countof(name), rec.path, rec.segment);
+    mappings.unmap(rec.base, rec.segment_bytes);
+    handles.close(rec.mapping);
+    rec.base = null;
+    rec.mapping = null;
+    uint64_t used = rec.offset; // give back the tail that was never written
+    handle_t h = mappings.file(name, &used, true);
+    if (h != null) { handles.close(h); }
+    rec.written += rec.offset;
+    rec.segment++;
+}
+
+static bool stage_next(volatile shared_memory_t* sm, int i) {
+    const uint32_t capacity = streams.directory(sm, i)->frame_bytes;
+    recording_frame_t* f = (recording_frame_t*)rec.staged[i];
+    frame_info_t info;
+    if (!client.read_next(i, f + 1, capacity, &info)) { return false; }
+    f->ns = info.timestamp >= sm->clock.ticks ?
+        sm->clock.ns + clocks.ns(&sm->clock, info.timestamp - sm->clock.ticks) : sm->clock.ns;
+    f->overrun = info.overrun;
+    f->stream = i;
+    f->bytes = info.bytes < capacity ? info.bytes : capacity;
+    f->sequence = info.sequence;
+    return true;
+}
+
+static void record_notify(shared_memory_t* sm) {
+    if (rec.notification != null) { events.set(rec.notification); }
+}
+
+static int select_streams(volatile shared_memory_t* sm, const char* list, uint64_t* mask) {
+    *mask = 0;
+    const int n = (int)sm->stream_count;
+    if (list == null) { // all
+        *mask = n == 64 ? UINT64_MAX : (1ULL << n) - 1;
+        return 0;
+    }
+    while (*list != 0) {
+        const char* end = strchr(list, ',');
+        const int bytes = end != null ? (int)(end - list) : (int)strlen(list);
+        int found = -1;
+        for (int i = 0; i < n && found < 0; i++) {
+            const char* name = (const char*)streams.directory(sm, i)->name;
+            if ((int)strlen(name) == bytes && memcmp(name, list, bytes) == 0) { found = i; }
+        }
+        if (found < 0) {
+            traceln("invalid --streams: no stream \"%.*s\"", bytes, list);
+            return EINVAL;
+        }
+        *mask |= 1ULL << found;
+        list += end != null ? bytes + 1 : bytes;
+    }
+    return *mask != 0 ? 0 : EINVAL;
+}
+
+static int record(int argc, const char* argv[]) {
+    const char* s = null;
+    rec.path = option_value(argc, argv, "--file");
+    const double seconds = (s = option_value(argc, argv, "--seconds")) != null ? atof(s) : 10;
+    rec.segment_bytes = (s = option_value(argc, argv, "--segment")) != null ?
+        (uint64_t)atoll(s) * 1024 * 1024 : recording_segment_bytes;
+    volatile shared_memory_t* sm = client.view();
+    uint64_t mask = 0;
+    if (rec.path == null || seconds <= 0 || rec.segment_bytes == 0) {
+        traceln("rpc record --file path [--streams name,...] [--seconds s] [--segment MB]");
+        return EINVAL;
+    }
+    int r = select_streams(sm, option_value(argc, argv, "--streams"), &mask);
+    if (r != 0) { return r; }
+    uint32_t largest = 0;
+    memset(&rec.header, 0, sizeof(rec.header));
+    rec.header.magic = recording_magic;
+    rec.header.stream_count = sm->stream_count;
+    rec.header.streams = mask;
+    for (int i = 0; i < (int)sm->stream_count; i++) {
+        volatile shared_directory_t* d = streams.directory(sm, i);
+        memcpy(rec.header.names[i], (const char*)d->name, sizeof(rec.header.names[i])); // zero padded
+        if ((mask & (1ULL << i)) && d->frame_bytes > largest) { largest = d->frame_bytes; }
+    }
+    // the largest frame and the end of segment record always fit after the header
+    const uint64_t room = record_bytes(largest) + sizeof(recording_frame_t);
+    if (rec.segment_bytes < sizeof(recording_header_t) + room) {
+        traceln("invalid --segment: frames of %u bytes do not fit", largest);
+        return EINVAL;
+    }
+    rec.segment = 0;
+    rec.written = 0;
+    r = segment_create();
+    if (r != 0) { return r; }
+    for (int i = 0; i < (int)sm->stream_count; i++) {
+        if (mask & (1ULL << i)) {
+            const uint64_t bytes = record_bytes(streams.directory(sm, i)->frame_bytes);
+            fatal_if_null(rec.staged[i] = (byte*)heap.alloc(bytes));
+            rec.full[i] = false;
+        }
+    }
+    rec.notification = events.create();
+    client.notify = record_notify;
+    fatal_if_not_zero(client.subscribe(mask));
+    int64_t frames = 0;
+    uint64_t overrun = 0;
+    const uint64_t start = nanoseconds_since_boot();
+    const uint64_t deadline = start + (uint64_t)(seconds * 1e9);
+    while (r == 0 && nanoseconds_since_boot() < deadline) {
+        events.wait_or_timeout(rec.notification, 100); // slow streams: check the deadline
+        // merge: the earliest of the staged frames goes next until every
+        // stream is drained (a frame committed after the drain may still be
+        // stamped earlier than the last one written, replay clamps that)
+        while (r == 0) {
+            int next = -1;
+            for (int i = 0; i < (int)sm->stream_count; i++) {
+                if ((mask & (1ULL << i)) == 0) { continue; }
+                if (!rec.full[i]) { rec.full[i] = stage_next(sm, i); }
+                if (rec.full[i] && (next < 0 ||
+                    ((recording_frame_t*)rec.staged[i])->ns < ((recording_frame_t*)rec.staged[next])->ns)) {
+                    next = i;
+                }
+            }
+            if (next < 0) { break; }
+            const recording_frame_t* f = (const recording_frame_t*)rec.staged[next];
+            if (rec.offset + record_bytes(f->bytes) + sizeof(recording_frame_t) > rec.segment_bytes) {
+                segment_close();
+                r = segment_create();
+                if (r != 0) { break; }
+            }
+            memcpy(rec.base + rec.offset, f, sizeof(recording_frame_t) + f->bytes);
+            rec.offset += record_bytes(f->bytes);
+            memset(rec.base + rec.offset, 0, sizeof(recording_frame_t)); // end of segment
+            overrun += f->overrun;
+            frames++;
+            rec.full[next] = false;
+        }
+    }
+    fatal_if_not_zero(client.unsubscribe(mask));
+    client.notify = null;
+    if (rec.base != null) { segment_close(); }
+    events.dispose(rec.notification);
+    rec.notification = null;
+    for (int i = 0; i < max_streams; i++) {
+        heap.free(rec.staged[i]);
+        rec.staged[i] = null;
+    }
+    const double elapsed = (nanoseconds_since_boot() - start) / 1e9;
+    traceln("recorded %lld frames %.1fMB in %d segments of \"%s\" overrun %llu %.1f frames/s",
+            (long long)frames, rec.written / (1024.0 * 1024.0), rec.segment, rec.path,
+            (unsigned long long)overrun, frames / elapsed);
+    return r;
+}
+
+static void recording_unmap(recording_t* r) {
+    if (r->base != null) { mappings.unmap(r->base, r->bytes); }
+    if (r->mapping != null) { handles.close(r->mapping); }
+    r->base = null;
+    r->mapping = null;
+}
+
+static bool recording_map(recording_t* r, int segment) {
+    recording_unmap(r);
+    char name[300];
+    segment_name(name, countof(name), r->path, segment);
+    r->bytes = 0;
+    r->mapping = mappings.file(name, &r->bytes, false);
+    if (r->mapping == null) { return false; }
+    if (r->bytes < sizeof(recording_header_t)) {
+        handles.close(r->mapping);
+        r->mapping = null;
+        return false;
+    }
+    r->base = (byte*)mappings.map(r->mapping, r->bytes, false);
+    const recording_header_t* h = (const recording_header_t*)r->base;
+    if (h->magic != recording_magic || h->segment != (uint32_t)segment) {
+        traceln("%s is not segment %d of a recording", name, segment);
+        recording_unmap(r);
+        return false;
+    }
+    r->segment = segment;
+    r->offset = sizeof(recording_header_t);
+    return true;
+}
+
+static bool recording_open(recording_t* r, const char* path) {
+    memset(r, 0, sizeof(*r));
+    strncpy(r->path, path, sizeof(r->path) - 1);
+    if (!recording_map(r, 0)) { return false; }
+    memcpy(&r->header, r->base, sizeof(r->header));
+    return true;
+}
+
+static const recording_frame_t* recording_next(recording_t* r) {
+    while (r->base != null) {
+        if (r->offset + sizeof(recording_frame_t) <= r->bytes) {
+            const recording_frame_t* f = (const recording_frame_t*)(r->base + r->offset);
+            if (f->sequence != 0 && r->offset + record_bytes(f->bytes) <= r->bytes) {
+                r->offset += record_bytes(f->bytes);
+                return f;
+            }
+        }
+        if (!recording_map(r, r->segment + 1)) { break; }
+    }
+    return null;
+}
+
+static void recording_rewind(recording_t* r) {
+    if (r->base != null && r->segment == 0) {
+        r->offset = sizeof(recording_header_t);
+    } else {
+        recording_map(r, 0);
+    }
+}
+
+static void recording_close(recording_t* r) {
+    recording_unmap(r);
+}
+
+recordings_if recordings = {
+    record,
+    recording_open,
+    recording_next,
+    recording_rewind,
+    recording_close
+};
+
+end_c
@@ -0,0 +1,65 @@
+#pragma once
+#include "win64s.h"
+#include "server.h"
+
+begin_c
+
+// Recordings of published frames for replay. A recording is a sequence
+// of segment files "<path>.0000", "<path>.0001" ... Each segment starts
+// with recording_header_t followed by records
+// [recording_frame_t][payload padded to 8 bytes]; a record with sequence 0
+// (or the end of the file) ends the segment.
+//
+// The recorder reads frames losslessly with client.read_next() straight
+// into the mapped segment: one copy per frame and strictly sequential
+// writes that the kernel writes back in large chunks.
+
+enum {
+    recording_magic         = 0x31435052, // "RPC1"
+    recording_segment_bytes = 64 * 1024 * 1024 // default, rpc record --segment MB
+};
+
+typedef struct recording_header_s {
+    uint32_t magic;
+    uint32_t segment;            // index of the file in the recording
+    uint32_t stream_count;       // of the recorded server
+    uint32_t reserved;
+    uint64_t streams;            // bitmask of recorded streams
+    char names[max_streams][32]; // of the server streams, by index
+} recording_header_t;
+
+typedef struct recording_frame_s {
+    uint64_t sequence; // of the frame in its stream, 0: end of segment
+    uint64_t ns;       // frame timestamp as nanoseconds_since_boot() of the server
+    uint64_t overrun;  // frames of the stream the recorder lost right before this one
+    uint32_t stream;   // index into recording_header_t.names
+    uint32_t bytes;    // of payload that follows
+} recording_frame_t;
+
+typedef struct recording_s { // replay cursor
+    char path[260];
+    recording_header_t header; // of the first segment
+    int segment;
+    handle_t mapping;
+    byte* base;
+    uint64_t bytes;  // of the mapped segment
+    uint64_t offset; // of the next record
+} recording_t;
+
+typedef struct recordings_if {
+    // rpc record --file path [--streams name,...] [--seconds s] [--segment MB]
+    // appends every frame of the streams (default all) to the recording
+    // for `seconds` (default 10). Client must be connected
+    int (*record)(int argc, const char* argv[]);
+    // replay: false if "<path>.0000" is not a recording
+    bool (*open)(recording_t* r, const char* path);
+    // next frame in recording order, payload follows it; null at the end.
+    // Valid until the next call
+    const recording_frame_t* (*next)(recording_t* r);
+    void (*rewind)(recording_t* r);
+    void (*close)(recording_t* r);
+} recordings_if;
+
+extern recordings_if recordings;
+
+end_c
@@ -1,252 +1,1116 @@
 #include "win64s.h"
+#ifdef _WIN32
 #include <rpc.h>
 #include "iface_h.h"
+#pragma comment(lib, "rpcrt4.lib")
+#else
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include "uds.h"
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434 // Linux 5.3
+#endif
+#endif
 #include "client.h"
 #include "server.h"
-
-#pragma comment(lib, "rpcrt4.lib")
+#include "kv.h"
+#include "stats.h"
+#include "upload.h"
+#include "journal.h"
 
 begin_c
 
 typedef struct client_info_s {
-    handle_t context; // rpc context
-    handle_t notification; // event
+    handle_t context; // rpc context, null for an empty entry
+    int32_t slot; // index of shared_client_t
     uint32_t client_pid;
-    volatile int32_t running; // start()/stop() calls counter
+    uint64_t streams; // subscribed streams bitmask
+    uint32_t watch; // id of the process exit watch
+#ifdef _WIN32
+    handle_t process; // SYNCHRONIZE access to client process or null
+    handle_t wait;    // RegisterWaitForSingleObject() on process
+#else
+    int pidfd;        // in s.watch_set or -1
+#endif
 } client_info_t;
 
-const uint64_t shared_memory_size = sizeof(shared_memory_t);
+enum { registry_shards = 16 }; // power of 2
+
+// Clients are spread over shards by context so that connects, start/stop
+// and disconnects of different clients do not contend on one lock. Each
+// shard is an open addressed (linear probing) table that doubles when it
+// is half full; removal shifts the following entries back (no tombstones).
+typedef struct registry_shard_s {
+    mutex_t lock;
+    client_info_t* clients;
+    int32_t capacity; // power of 2
+    int32_t count;
+} registry_shard_t;
+
+// Dense array of the slots subscribed to a stream (or of the wake groups
+// containing it), notify() walks it without a lock. Removal moves the last
+// entry into the hole, it is bracketed by odd generation so that
+// a concurrent walk is repeated.
+typedef struct subscribers_s {
+    int32_t* slots; // [client_slots] or [wake_groups(client_slots)]
+    volatile int32_t count;
+    volatile uint32_t generation; // odd while an entry is being removed
+} subscribers_t;
 
 static struct {
     handle_t mapping;
-    thread_t cleaner;
+    uint64_t size; // of the mapping, laid out from server.topology()
+    volatile handle_t* slot_context; // [client_slots] for process exit watches
+    volatile int32_t watches; // last watch id
+#ifndef _WIN32
+    thread_t watcher;
+    int watch_set; // epoll of client pidfds
+#endif
     shared_memory_t* shared_memory;
-    client_info_t clients[128];
-    int32_t client_count;
-    int32_t deaf_count; // number of notifications nobody listened to
-    CRITICAL_SECTION cs;
-    volatile bool locked;
+    volatile shared_stats_t* stats; // inside shared_memory
+    int32_t client_slots; // server.client_slots() at start
+    registry_shard_t shards[registry_shards];
+    broadcast_t* wake; // [wake_groups(client_slots)] kept for server lifetime
+    subscribers_t subscribers[max_streams];
+    int32_t* subscriber_index; // [client_slots * max_streams] position in subscribers[].slots
+    subscribers_t groups[max_streams]; // wake groups to publish on notify() of the stream
+    int32_t* group_index; // [wake_groups(client_slots) * max_streams] position in groups[].slots
+    int32_t* free_slots; // stack of free shared_client_t slots
+    int32_t free_count;
+    mutex_t slots_lock; // free_slots
+    mutex_t subscriptions; // subscribers[], groups[], stream running counts and server.start()/stop() calls
+    mutex_t writer; // single writer of kv table and blob arena, readers take no lock
+    volatile bool writing;
+    handle_t* upload_mappings; // [client_slots] created on connect, closed on disconnect
+    volatile shared_upload_t** upload; // [client_slots] null: no client in the slot
+    broadcast_t* replied; // [client_slots] of upload rings: wakes set() callers
+    mutex_t uploads_lock; // upload[] and upload_mappings[] against the drainer
+    volatile shared_doorbell_t* doorbell_shared; // inside shared_memory
+    broadcast_t doorbell; // rung by clients with records to drain
+    thread_t drainer;
+    byte* scratch; // copy of the upload record being parsed
     volatile bool shutdown;
     bool endpoint_in_use;
 } s;
 
-#define lock() do { EnterCriticalSection(&s.cs); assert(!s.locked); s.locked = true; } while (0)
-#define unlock() do { assert(s.locked); s.locked = false; LeaveCriticalSection(&s.cs); } while (0)
+#define lock_writer() do { mutexes.lock(&s.writer); assert(!s.writing); s.writing = true; } while (0)
+#define unlock_writer() do { assert(s.writing); s.writing = false; mutexes.unlock(&s.writer); } while (0)
+
+static void* allocate_zeroed(uint64_t bytes) {
+    void* p = null;
+    fatal_if_null(p = heap.alloc(bytes));
+    memset(p, 0, bytes);
+    return p;
+}
 
 static void create_shared_memory() {
-    const uint64_t size = (shared_memory_size + 4095) / 4096 * 4096;
-    fatal_if_null(s.mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, null, PAGE_READWRITE,
-        (uint32_t)(size >> 32), (uint32_t)size, null));
-    assert(s.mapping != null, "CreateFileMappingA() failed %s", last_error());
-    s.shared_memory = MapViewOfFile(s.mapping, FILE_MAP_ALL_ACCESS, 0, (uint32_t)(size >> 32), (uint32_t)size);
-    assert(s.shared_memory != null, "MapViewOfFile() failed %s", last_error());
+    const stream_descriptor_t* table = null;
+    const int n = server.topology(&table);
+    const int slots = s.client_slots;
+    const uint64_t line = cache_line;
+    const uint64_t kv_offset = (streams.size(table, n, slots) + line - 1) / line * line;
+    const uint64_t blobs_offset = (kv_offset + kv.size(kv_buckets) + line - 1) / line * line;
+    const uint64_t stats_offset = (blobs_offset + blobs.size(kv_buckets, blob_arena_bytes) + line - 1) / line * line;
+    const uint64_t uploads_offset = (stats_offset + stats.size(slots) + line - 1) / line * line;
+    s.size = (uploads_offset + uploads.size(slots) + 4095) / 4096 * 4096;
+    const memory_options_t* mo = server.memory();
+    const uint64_t page = mo->large_pages && mo->file == null ? mappings.large_page_size() : 0;
+    const bool file = mo->file != null;
+    s.mapping = null;
+    if (file) {
+        // fresh file every start: the layout expects zeroed memory
+        uint64_t bytes = 0;
+        handle_t h = mappings.file(mo->file, &bytes, true);
+        if (h != null) { handles.close(h); }
+        bytes = s.size;
+        fatal_if_null(s.mapping = mappings.file(mo->file, &bytes, true), "%s", mo->file);
+        if (mo->large_pages || mo->numa_node >= 0) { traceln("file backed memory is not placed"); }
+    }
+    if (page > 0) {
+        const uint64_t bytes = (s.size + page - 1) / page * page;
+        s.mapping = mappings.create_placed(bytes, true, mo->numa_node);
+        if (s.mapping != null) { s.size = bytes; }
+    }
+    const bool large = page > 0 && s.mapping != null;
+    if (mo->large_pages && !large && !file) { traceln("large pages are not available: %s", last_error()); }
+    if (!large && !file && mo->numa_node >= 0) {
+        s.mapping = mappings.create_placed(s.size, false, mo->numa_node);
+        if (s.mapping == null) { traceln("NUMA node %d is not available: %s", mo->numa_node, last_error()); }
+    }
+    const bool placed = s.mapping != null && !file && mo->numa_node >= 0;
+    if (s.mapping == null) { s.mapping = mappings.create(s.size); }
+    s.shared_memory = (shared_memory_t*)mappings.map(s.mapping, s.size, true);
+    // page faults are taken here and not on the first touch of each frame
+    const bool locked = mo->lock && mappings.lock(s.shared_memory, s.size);
+    if (mo->lock && !locked) { traceln("shared memory is prefaulted but not locked: %s", last_error()); }
+    streams.layout(s.shared_memory, table, n, slots);
+    kv.layout(s.shared_memory, kv_offset, kv_buckets);
+    blobs.layout(s.shared_memory, blobs_offset, kv_buckets, blob_arena_bytes);
+    stats.layout(s.shared_memory, stats_offset, slots);
+    s.stats = stats.at(s.shared_memory);
+    uploads.layout(s.shared_memory, uploads_offset, slots);
+    s.doorbell_shared = uploads.doorbell(s.shared_memory);
+    s.shared_memory->options = (large ? memory_large_pages : 0) |
+                               (mo->lock ? memory_locked : 0);
+    s.shared_memory->numa_node = placed ? mo->numa_node : -1;
 }
 
-static int find_client(handle_t context) {
-    int ix = -1;
-    for (int i = 0; i < s.client_count && ix < 0; i++) {
-        if (s.clients[i].context == context) { ix = i; }
+static void create_registry() {
+    const int slots = s.client_slots;
+    s.wake = (broadcast_t*)allocate_zeroed(wake_groups(slots) * sizeof(broadcast_t));
+    s.subscriber_index = (int32_t*)allocate_zeroed((uint64_t)slots * max_streams * sizeof(int32_t));
+    s.group_index = (int32_t*)allocate_zeroed((uint64_t)wake_groups(slots) * max_streams * sizeof(int32_t));
+    s.free_slots = (int32_t*)allocate_zeroed(slots * sizeof(int32_t));
+    s.slot_context = (volatile handle_t*)allocate_zeroed(slots * sizeof(handle_t));
+    s.upload_mappings = (handle_t*)allocate_zeroed(slots * sizeof(handle_t));
+    s.upload = (volatile shared_upload_t**)allocate_zeroed(slots * sizeof(shared_upload_t*));
+    s.replied = (broadcast_t*)allocate_zeroed(slots * sizeof(broadcast_t));
+    for (int i = 0; i < slots; i++) { s.free_slots[i] = slots - 1 - i; } // slot 0 first
+    s.free_count = slots;
+    for (int i = 0; i < (int)s.shared_memory->stream_count; i++) {
+        s.subscribers[i].slots = (int32_t*)allocate_zeroed(slots * sizeof(int32_t));
+        s.groups[i].slots = (int32_t*)allocate_zeroed(wake_groups(slots) * sizeof(int32_t));
+    }
+    for (int i = 0; i < registry_shards; i++) {
+        registry_shard_t* sh = &s.shards[i];
+        sh->capacity = 16;
+        sh->clients = (client_info_t*)allocate_zeroed(sh->capacity * sizeof(client_info_t));
     }
-    return ix;
 }
 
-static bool add_client(handle_t context, uint32_t client_pid, handle_t notification) {
-    bool b = false;
-    assert(0 <= s.client_count && s.client_count <= countof(s.clients));
-    assert(find_client(context) < 0);
-    if (s.client_count == countof(s.clients)) {
-        s.client_count = countof(s.clients);
-    } else {
-        s.clients[s.client_count].client_pid = client_pid;
-        s.clients[s.client_count].notification = notification;
-        s.clients[s.client_count].context = context;
-        s.clients[s.client_count].running = 0;
-        s.client_count++;
-        b = true;
+static void unwatch_client(client_info_t* ci);
+
+static void dispose_registry() {
+    for (int i = 0; i < registry_shards; i++) {
+        registry_shard_t* sh = &s.shards[i];
+        for (int j = 0; j < sh->capacity; j++) {
+            if (sh->clients[j].context != null) { unwatch_client(&sh->clients[j]); }
+        }
+        heap.free(sh->clients);
+        sh->clients = null;
+        sh->capacity = 0;
+        sh->count = 0;
+    }
+    for (int i = 0; i < max_streams; i++) {
+        heap.free(s.subscribers[i].slots);
+        s.subscribers[i].slots = null;
+        heap.free(s.groups[i].slots);
+        s.groups[i].slots = null;
+    }
+    for (int i = 0; i < wake_groups(s.client_slots); i++) {
+        if (s.wake[i].shared != null) { broadcasts.dispose(&s.wake[i]); }
+    }
+    for (int i = 0; i < s.client_slots; i++) {
+        if (s.upload[i] != null) {
+            broadcasts.dispose(&s.replied[i]);
+            mappings.unmap((void*)s.upload[i], sizeof(shared_upload_t));
+        }
+        if (s.upload_mappings[i] != null) { handles.close(s.upload_mappings[i]); }
+    }
+    heap.free(s.replied);
+    heap.free((void*)s.upload);
+    heap.free(s.upload_mappings);
+    heap.free((void*)s.slot_context);
+    heap.free(s.free_slots);
+    heap.free(s.subscriber_index);
+    heap.free(s.group_index);
+    heap.free(s.wake);
+}
+
+static uint64_t all_streams() {
+    const uint32_t n = s.shared_memory->stream_count;
+    return n >= 64 ? ~0ULL : (1ULL << n) - 1;
+}
+
+static uint64_t context_hash(handle_t context) { // Fibonacci hashing
+    return (uint64_t)(uintptr_t)context * 0x9E3779B97F4A7C15ULL;
+}
+
+static registry_shard_t* shard_of(handle_t context) {
+    return &s.shards[context_hash(context) >> 60 & (registry_shards - 1)];
+}
+
+static int32_t home_of(registry_shard_t* sh, handle_t context) {
+    return (int32_t)(context_hash(context) >> 28) & (sh->capacity - 1);
+}
+
+static client_info_t* find_client(registry_shard_t* sh, handle_t context) {
+    for (int32_t i = home_of(sh, context); sh->clients[i].context != null;
+         i = (i + 1) & (sh->capacity - 1)) {
+        if (sh->clients[i].context == context) { return &sh->clients[i]; }
     }
-    return b;
+    return null;
 }
 
-static void remove_client_at(int ix) {
-    assert(0 < s.client_count && s.client_count <= countof(s.clients));
-    assert(0 <= ix && ix < s.client_count);
-    if (ix >= 0) {
-        handles.close(s.clients[ix].notification);
-        s.shared_memory->running -= s.clients[ix].running;
-        traceln("removing client[%d] pid=%d running=%d", ix, s.clients[ix].client_pid, s.clients[ix].running);
-        s.client_count--;
-        const int n = s.client_count; // last
-        s.clients[ix] = s.clients[n];
-        s.clients[n].client_pid = 0;
-        s.clients[n].notification = null;
-        s.clients[n].running = 0;
+static client_info_t* insert_client(registry_shard_t* sh, const client_info_t* ci) {
+    int32_t i = home_of(sh, ci->context);
+    while (sh->clients[i].context != null) { i = (i + 1) & (sh->capacity - 1); }
+    sh->clients[i] = *ci;
+    sh->count++;
+    return &sh->clients[i];
+}
+
+static void grow_registry_shard(registry_shard_t* sh) {
+    client_info_t* clients = sh->clients;
+    const int32_t capacity = sh->capacity;
+    sh->capacity = capacity * 2;
+    sh->clients = (client_info_t*)allocate_zeroed(sh->capacity * sizeof(client_info_t));
+    sh->count = 0;
+    for (int32_t i = 0; i < capacity; i++) {
+        if (clients[i].context != null) { insert_client(sh, &clients[i]); }
     }
-    assert(0 <= s.client_count && s.client_count <= countof(s.clients));
+    heap.free(clients);
+}
+
+static void erase_client(registry_shard_t* sh, client_info_t* ci) {
+    const int32_t mask = sh->capacity - 1;
+    int32_t hole = (int32_t)(ci - sh->clients);
+    for (int32_t i = (hole + 1) & mask; sh->clients[i].context != null; i = (i + 1) & mask) {
+        // entry may fill the hole if its home is not in (hole, i]
+        const int32_t home = home_of(sh, sh->clients[i].context);
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            sh->clients[hole] = sh->clients[i];
+            hole = i;
+        }
+    }
+    memset(&sh->clients[hole], 0, sizeof(sh->clients[hole]));
+    sh->count--;
+}
+
+static int claim_free_slot() {
+    mutexes.lock(&s.slots_lock);
+    int slot = s.free_count > 0 ? s.free_slots[--s.free_count] : -1;
+    mutexes.unlock(&s.slots_lock);
+    return slot;
+}
+
+static void release_slot(int slot) {
+    mutexes.lock(&s.slots_lock);
+    assert(s.free_count < s.client_slots);
+    s.free_slots[s.free_count++] = slot;
+    mutexes.unlock(&s.slots_lock);
+}
+
+static void process_exited(uint64_t key);
+
+#ifdef _WIN32
+
+static void CALLBACK process_wait_callback(void* key, BOOLEAN timed_out) {
+    process_exited((uint64_t)(uintptr_t)key);
+}
+
+#endif
+
+// client is removed as soon as its process exits (not by polling all of
+// them): the key identifies the watch in slot even if slot is reused
+static void watch_client(client_info_t* ci) {
+    const uint64_t key = (uint64_t)ci->watch << 32 | (uint32_t)ci->slot;
+#ifdef _WIN32
+    ci->wait = null;
+    ci->process = OpenProcess(SYNCHRONIZE, false, ci->client_pid);
+    if (ci->process != null) {
+        fatal_if_false(RegisterWaitForSingleObject(&ci->wait, ci->process, process_wait_callback,
+                       (void*)(uintptr_t)key, INFINITE, WT_EXECUTEONLYONCE));
+    }
+#else
+    // without pidfd (before Linux 5.3) closed socket still removes the client
+    ci->pidfd = (int)syscall(SYS_pidfd_open, (pid_t)ci->client_pid, 0);
+    if (ci->pidfd >= 0) {
+        struct epoll_event ev = { 0 };
+        ev.events = EPOLLIN; // readable when process exits
+        ev.data.u64 = key;
+        fatal_if_false(epoll_ctl(s.watch_set, EPOLL_CTL_ADD, ci->pidfd, &ev) == 0);
+    }
+#endif
+}
+
+static void unwatch_client(client_info_t* ci) {
+#ifdef _WIN32
+    // does not wait for running callback: it will not find the watch
+    if (ci->wait != null) { UnregisterWaitEx(ci->wait, null); }
+    if (ci->process != null) { handles.close(ci->process); }
+    ci->wait = null;
+    ci->process = null;
+#else
+    if (ci->pidfd >= 0) { close(ci->pidfd); } // also removes it from watch_set
+    ci->pidfd = -1;
+#endif
+}
+
+// `index` is the position of each entry in the subscribers_t of every stream
+
+static void subscribers_add(subscribers_t* sub, int32_t* index, int stream, int entry) {
+    const int32_t i = sub->count;
+    sub->slots[i] = entry;
+    index[entry * max_streams + stream] = i;
+    fence_release(); // entry is written before it is counted
+    sub->count = i + 1;
+}
+
+static void subscribers_remove(subscribers_t* sub, int32_t* index, int stream, int entry) {
+    const int32_t i = index[entry * max_streams + stream];
+    const int32_t last = sub->count - 1;
+    assert(0 <= i && i <= last && sub->slots[i] == entry);
+    sub->generation++;
+    fence_release(); // odd generation is visible before entries move
+    const int32_t moved = sub->slots[last];
+    sub->slots[i] = moved;
+    index[moved * max_streams + stream] = i;
+    sub->count = last;
+    fence_release(); // entries have moved before generation is even again
+    sub->generation++;
+}
+
+static int32_t group_enter(uint64_t set) {
+    // at most one group per distinct set: found by a scan, subscriptions
+    // change rarely and notify() publishes each group once whatever its size
+    int32_t g = 0; // of the empty set
+    if (set != 0) {
+        int32_t free = -1;
+        for (g = 1; g < wake_groups(s.client_slots); g++) {
+            volatile shared_group_t* gr = streams.group(s.shared_memory, g);
+            if (gr->members > 0 && gr->streams == set) { break; }
+            if (gr->members == 0 && free < 0) { free = g; }
+        }
+        if (g == wake_groups(s.client_slots)) { g = free; }
+        assert(g > 0); // there are more groups than sets in use
+    }
+    volatile shared_group_t* gr = streams.group(s.shared_memory, g);
+    if (s.wake[g].shared == null) {
+        broadcasts.init(&s.wake[g], (broadcast_shared_t*)&gr->wake, null);
+        for (int i = 0; i < countof(gr->parity); i++) {
+            gr->parity[i] = (uint64_t)(uintptr_t)s.wake[g].parity[i]; // null on Linux
+        }
+    }
+    if (gr->members == 0) {
+        gr->streams = set;
+        for (int i = 0; i < (int)s.shared_memory->stream_count; i++) {
+            if (set & (1ULL << i)) { subscribers_add(&s.groups[i], s.group_index, i, g); }
+        }
+    }
+    gr->members++;
+    return g;
+}
+
+static void group_leave(int32_t g) {
+    volatile shared_group_t* gr = streams.group(s.shared_memory, g);
+    assert(gr->members > 0);
+    gr->members--;
+    if (gr->members == 0) {
+        for (int i = 0; i < (int)s.shared_memory->stream_count; i++) {
+            if (gr->streams & (1ULL << i)) { subscribers_remove(&s.groups[i], s.group_index, i, g); }
+        }
+    }
+}
+
+static void move_to(int slot, int32_t to, int32_t joined) {
+    // The client waits on group `to` (-1: none, it is removed) for
+    // generations after `joined` from now on. It is still a member of the previous group until the wake
+    // below: frames of the streams it keeps that are notified before
+    // `joined` was read (to was already published for them) wake it there.
+    volatile shared_client_t* sc = streams.client(s.shared_memory, slot);
+    const int32_t from = sc->group;
+    sc->joined = joined;
+    fence_release(); // joined is written before the group it is a generation of
+    sc->group = to;
+    if (from >= 0) {
+        broadcasts.publish(&s.wake[from]); // kicks the client off (extra wake for other members)
+        group_leave(from);
+    }
+}
+
+static void enter_group(int slot, uint64_t set) {
+    const int32_t to = group_enter(set);
+    move_to(slot, to, streams.group(s.shared_memory, to)->wake.generation);
+}
+
+static int add_client(registry_shard_t* sh, handle_t context, uint32_t client_pid) {
+    assert(find_client(sh, context) == null);
+    int slot = client_pid != 0 ? claim_free_slot() : -1;
+    if (slot >= 0) {
+        volatile shared_client_t* sc = streams.client(s.shared_memory, slot);
+        // a fresh ring per client: mapped by the server and by this client
+        // only, a stale writer of the previous client cannot reach it
+        handle_t mapping = null;
+        fatal_if_null(mapping = mappings.create(sizeof(shared_upload_t)));
+        volatile shared_upload_t* u = (volatile shared_upload_t*)mappings.map(mapping,
+            sizeof(shared_upload_t), true);
+        fatal_if_null(u);
+        if (s.shared_memory->options & memory_locked) {
+            mappings.lock((void*)u, sizeof(shared_upload_t));
+        }
+        broadcasts.init(&s.replied[slot], (broadcast_shared_t*)&u->replied, null);
+        for (int i = 0; i < countof(u->parity); i++) {
+            u->parity[i] = (uint64_t)(uintptr_t)s.replied[slot].parity[i]; // null on Linux
+        }
+        mutexes.lock(&s.uploads_lock);
+        assert(s.upload[slot] == null && s.upload_mappings[slot] == null);
+        s.upload_mappings[slot] = mapping;
+        s.upload[slot] = u;
+        mutexes.unlock(&s.uploads_lock);
+        volatile shared_client_stats_t* cs = stats.client(s.stats, slot);
+        cs->wakes = 0;
+        cs->deaf = 0;
+        cs->uploads = 0;
+        for (int i = 0; i < (int)s.shared_memory->stream_count; i++) {
+            *streams.cursor(s.shared_memory, slot, i) = stream_no_cursor;
+            *streams.snapshot(s.shared_memory, slot, i) = 0;
+        }
+        sc->streams = 0;
+        sc->group = -1;
+        mutexes.lock(&s.subscriptions);
+        enter_group(slot, 0); // waits on the group of the empty set
+        mutexes.unlock(&s.subscriptions);
+        sc->ack = sc->joined;
+        sc->pid = client_pid;
+        if ((sh->count + 1) * 2 > sh->capacity) { grow_registry_shard(sh); }
+        client_info_t ci = { context, slot, client_pid, 0 };
+        ci.watch = (uint32_t)atomic_add32(&s.watches, 1);
+        s.slot_context[slot] = context;
+        watch_client(insert_client(sh, &ci));
+    }
+    return slot;
+}
+
+static void snapshot_at(client_info_t* ci, uint64_t added) {
+    // Consistent cut of the added streams, taken after the group of the
+    // new set is published by their notify() and before the call returns:
+    // a frame committed after its sequence is read here is notified after
+    // the group generation is read, so every wake past `joined` is for
+    // frames past the snapshot and the client starts from it without
+    // discarding anything.
+    const int32_t to = group_enter(ci->streams | added);
+    const int32_t generation = streams.group(s.shared_memory, to)->wake.generation;
+    fence_acquire(); // generation is read before the sequences
+    for (int i = 0; i < (int)s.shared_memory->stream_count; i++) {
+        if (added & (1ULL << i)) {
+            *streams.snapshot(s.shared_memory, ci->slot, i) = streams.at(s.shared_memory, i)->sequence;
+        }
+    }
+    fence_release(); // snapshot is complete before it is named by the generation
+    move_to(ci->slot, to, generation);
+}
+
+static void subscribe_at(client_info_t* ci, uint64_t set) {
+    const uint64_t added = set & ~ci->streams;
+    mutexes.lock(&s.subscriptions);
+    for (int i = 0; i < (int)s.shared_memory->stream_count; i++) {
+        if (added & (1ULL << i)) {
+            // subscriber is added before start() so the first frame wakes the client
+            *streams.cursor(s.shared_memory, ci->slot, i) = stream_no_cursor;
+            subscribers_add(&s.subscribers[i], s.subscriber_index, i, ci->slot);
+            volatile shared_stream_t* st = streams.at(s.shared_memory, i);
+            assert(st->running >= 0);
+            st->running++;
+            if (st->running == 1) { server.start(s.shared_memory, i); }
+        }
+    }
+    if (added != 0) { snapshot_at(ci, added); }
+    mutexes.unlock(&s.subscriptions);
+    ci->streams |= added;
+    streams.client(s.shared_memory, ci->slot)->streams = ci->streams;
+}
+
+static void unsubscribe_at(client_info_t* ci, uint64_t set) {
+    const uint64_t removed = set & ci->streams;
+    mutexes.lock(&s.subscriptions);
+    for (int i = 0; i < (int)s.shared_memory->stream_count; i++) {
+        if (removed & (1ULL << i)) {
+            subscribers_remove(&s.subscribers[i], s.subscriber_index, i, ci->slot);
+            *streams.cursor(s.shared_memory, ci->slot, i) = stream_no_cursor; // no backpressure
+            volatile shared_stream_t* st = streams.at(s.shared_memory, i);
+            assert(st->running > 0);
+            st->running--;
+            if (st->running == 0) { server.stop(i); }
+        }
+    }
+    if (removed != 0) { enter_group(ci->slot, ci->streams & ~removed); }
+    mutexes.unlock(&s.subscriptions);
+    ci->streams &= ~removed;
+    streams.client(s.shared_memory, ci->slot)->streams = ci->streams;
+}
+
+static void drain_slot(int slot);
+
+static void close_upload(int slot) {
+    // records the client left behind are applied before its ring goes away
+    mutexes.lock(&s.uploads_lock);
+    drain_slot(slot);
+    volatile shared_upload_t* u = s.upload[slot];
+    handle_t mapping = s.upload_mappings[slot];
+    s.upload[slot] = null;
+    s.upload_mappings[slot] = null;
+    mutexes.unlock(&s.uploads_lock);
+    broadcasts.dispose(&s.replied[slot]); // slot is released after this
+    mappings.unmap((void*)u, sizeof(shared_upload_t));
+    handles.close(mapping);
+}
+
+static void remove_client_at(registry_shard_t* sh, client_info_t* ci) {
+    traceln("removing client[%d] pid=%d streams=0x%llX", ci->slot, ci->client_pid,
+            (unsigned long long)ci->streams);
+    unsubscribe_at(ci, ci->streams);
+    unwatch_client(ci);
+    const int slot = ci->slot;
+    mutexes.lock(&s.subscriptions);
+    move_to(slot, -1, 0); // off the group of the empty set
+    mutexes.unlock(&s.subscriptions);
+    s.slot_context[slot] = null;
+    streams.client(s.shared_memory, slot)->pid = 0;
+    close_upload(slot);
+    erase_client(sh, ci);
+    release_slot(slot); // slot can be claimed again
 }
 
 static void remove_client(handle_t context) {
-    bool found = false;
-    int ix = find_client(context);
-    if (ix >= 0) { remove_client_at(ix); }
-}
-
-static bool is_client_process_alive(uint32_t client_pid) {
-    handle_t client_process = OpenProcess(PROCESS_DUP_HANDLE, false, client_pid);
-    if (client_process != null) { handles.close(client_process); }
-    return client_process != null;
-}
-
-static void cleanup_clients() {
-    assert(0 <= s.client_count && s.client_count <= countof(s.clients));
-    assert(s.shared_memory->running >= 0);
-    lock();
-    int32_t running = s.shared_memory->running; // before removing clients
-    int i = 0;
-    while (i < s.client_count) {
-        if (!is_client_process_alive(s.clients[i].client_pid)) {
-            remove_client_at(i);
-        } else {
-            i++;
+    registry_shard_t* sh = shard_of(context);
+    mutexes.lock(&sh->lock);
+    client_info_t* ci = find_client(sh, context);
+    if (ci != null) { remove_client_at(sh, ci); }
+    mutexes.unlock(&sh->lock);
+}
+
+static void process_exited(uint64_t key) {
+    const int slot = (int)(uint32_t)key;
+    const uint32_t watch = (uint32_t)(key >> 32);
+    handle_t context = s.slot_context[slot];
+    counter_add64(&s.stats->watches, 1);
+    if (context != null) {
+        registry_shard_t* sh = shard_of(context);
+        mutexes.lock(&sh->lock);
+        client_info_t* ci = find_client(sh, context);
+        // client may have disconnected and slot may belong to another one by now
+        if (ci != null && ci->slot == slot && ci->watch == watch) {
+            remove_client_at(sh, ci);
+            counter_add64(&s.stats->exits, 1);
         }
+        mutexes.unlock(&sh->lock);
     }
-    assert(s.shared_memory->running >= 0);
-    if (running > 0 && s.shared_memory->running == 0) { server.stop(); }
-    unlock();
-    assert(0 <= s.client_count && s.client_count <= countof(s.clients));
 }
 
-thread_proc(cleaner, {}, { cleanup_clients(); }, {})
+#ifndef _WIN32
 
-static void RPC_ENTRY client_disconnected(struct _RPC_ASYNC_STATE *async,
-                  void* context, RPC_ASYNC_EVENT rpc_event) {
-    if (rpc_event == RpcClientDisconnect) { // conext is always null
-        threads.notify(&s.cleaner);
-    } else {
-        traceln("rpc_event=%d context=%p", rpc_event, context);
+static uint32_t WINAPI watcher(void* p) {
+    thread_begin(p)
+    const uint64_t quit = UINT64_MAX;
+    struct epoll_event ev = { 0 };
+    ev.events = EPOLLIN;
+    ev.data.u64 = quit;
+    // threads.join() sets events[0]: exported event rings its eventfd
+    fatal_if_false(epoll_ctl(s.watch_set, EPOLL_CTL_ADD, posix_handle_export(self->events[0]), &ev) == 0);
+    for (;;) {
+        int n = epoll_wait(s.watch_set, &ev, 1, -1);
+        fatal_if_false(n >= 0 || errno == EINTR);
+        if (n > 0 && ev.data.u64 == quit) { break; }
+        if (n > 0) { process_exited(ev.data.u64); }
     }
+    thread_end
 }
 
+#endif
+
+#ifdef _WIN32
+
 static handle_t process_open(uint32_t pid) {
     handle_t process = null;
     fatal_if_null(process = OpenProcess(PROCESS_DUP_HANDLE, false, pid));
     return process;
 }
 
+#else
+
+static void client_disconnected(handle_t context) {
+    // unlike ncalrpc the transport knows exactly which client went away
+    remove_client(context);
+}
+
+#endif
+
 int s_rpc_connect(handle_t context, rpc_info_t* info) {
-    RPC_ASYNC_NOTIFICATION_INFO notification_info = {0};
-    notification_info.NotificationRoutine = client_disconnected;
-    fatal_if_not_zero(RpcServerSubscribeForNotification(context, RpcNotificationClientDisconnect, RpcNotificationTypeCallback, &notification_info));
-    info->server_pid = GetCurrentProcessId();
-    // server process should have the same of elevated privileges 
-    // relative to client process for process open to succeed 
+    const uint64_t start = stats.now();
+    info->server_pid = process_id();
+    registry_shard_t* sh = shard_of(context);
+    mutexes.lock(&sh->lock);
+    int slot = add_client(sh, context, (uint32_t)info->client_pid);
+    mutexes.unlock(&sh->lock);
+    int r = slot >= 0 ? 0 : ERROR_BLOCK_TOO_MANY_REFERENCES;
+    if (r == 0) {
+        info->slot = slot;
+#ifdef _WIN32
+        // server process should have the same of elevated privileges 
+        // relative to client process for process open to succeed 
+        handle_t client_process = process_open((uint32_t)info->client_pid);
+        handle_t server_process = process_open((uint32_t)info->server_pid);
+        handle_t client_mapping = null;
+        fatal_if_null(client_mapping = handles.dup(s.mapping, server_process, client_process));
+        fatal_if_null(info->upload = (rpc_uint64_t)handles.dup(s.upload_mappings[slot],
+            server_process, client_process));
+        for (int i = 0; i < countof(info->doorbell); i++) {
+            fatal_if_null(info->doorbell[i] = (rpc_uint64_t)handles.dup(s.doorbell.parity[i],
+                server_process, client_process));
+        }
+        handles.close(server_process);
+        handles.close(client_process);
+#else
+        // uds.c will send (and close) the mapping handles back with the reply,
+        // clients wait for notifications with futex on shared memory
+        handle_t client_mapping = handles.dup(s.mapping, null, null);
+        info->upload = (rpc_uint64_t)handles.dup(s.upload_mappings[slot], null, null);
+#endif
+        info->mapping = (rpc_uint64_t)client_mapping;
+        info->memory_size = s.size;
+        info->directory = s.shared_memory->directory;
+        counter_add64(&s.stats->connects, 1);
+    }
+    stats.call(s.shared_memory, rpc_method_connect, start, r);
+    return r;
+}
+
+int s_rpc_view(handle_t context, rpc_info_t* info) {
+    // read only observers (rpc stats): no slot, wake, upload ring or
+    // process watch, nothing to remove when they go away
+    const uint64_t start = stats.now();
+    info->server_pid = process_id();
+#ifdef _WIN32
     handle_t client_process = process_open((uint32_t)info->client_pid);
     handle_t server_process = process_open((uint32_t)info->server_pid);
-    handle_t notification = null;
-    fatal_if_null(notification = handles.dup((handle_t)info->notification, client_process, server_process));
     handle_t client_mapping = null;
     fatal_if_null(client_mapping = handles.dup(s.mapping, server_process, client_process));
-    info->mapping = (rpc_uint64_t)client_mapping;
-    info->memory_size = shared_memory_size;
     handles.close(server_process);
     handles.close(client_process);
-    lock();
-    int r = add_client(context, (uint32_t)info->client_pid, notification) ?
-        0 : ERROR_BLOCK_TOO_MANY_REFERENCES;
-    if (r != 0) { handles.close(notification); }
-    unlock();
-    return r;
+#else
+    handle_t client_mapping = handles.dup(s.mapping, null, null); // sent and closed by uds.c
+#endif
+    info->mapping = (rpc_uint64_t)client_mapping;
+    info->memory_size = s.size;
+    info->directory = s.shared_memory->directory;
+    stats.call(s.shared_memory, rpc_method_view, start, 0);
+    return 0;
+}
+
+static void notify(int stream) {
+    // no lock: publishes each wake group of the stream once, subscribers
+    // sharing a set of streams are woken by one syscall. Deaf subscribers
+    // are those that have not acknowledged the previous generation of their
+    // group (approximate while a client moves between groups).
+    // Producers of other streams (sharing subscribers) and of the same
+    // stream notify concurrently: counters are relaxed atomic adds.
+    assert(0 <= stream && stream < (int)s.shared_memory->stream_count);
+    const uint64_t start = stats.now();
+    subscribers_t* groups = &s.groups[stream];
+    for (;;) {
+        const uint32_t g = groups->generation;
+        fence_acquire(); // generation is read before the entries
+        if (g & 1) { spin_pause(); continue; } // entry is being removed
+        const int32_t n = groups->count;
+        fence_acquire(); // count is read before the entries it covers
+        for (int32_t i = 0; i < n; i++) { broadcasts.publish(&s.wake[groups->slots[i]]); }
+        fence_acquire(); // entries are read before generation
+        if (groups->generation == g) { break; }
+        // entries moved during the walk: walk again, extra wakes are harmless
+    }
+    subscribers_t* sub = &s.subscribers[stream];
+    int32_t deaf = 0;
+    int32_t n = 0;
+    for (;;) { // shared memory reads only, no syscalls
+        const uint32_t g = sub->generation;
+        fence_acquire(); // generation is read before the entries
+        if (g & 1) { spin_pause(); continue; } // entry is being removed
+        deaf = 0;
+        n = sub->count;
+        fence_acquire(); // count is read before the entries it covers
+        for (int32_t i = 0; i < n; i++) {
+            const int slot = sub->slots[i];
+            volatile shared_client_t* sc = streams.client(s.shared_memory, slot);
+            const int32_t group = sc->group;
+            volatile shared_client_stats_t* cs = stats.client(s.stats, slot);
+            counter_add64(&cs->wakes, 1);
+            if (group >= 0 && streams.group(s.shared_memory, group)->wake.generation - 1 - sc->ack > 0) {
+                deaf++;
+                counter_add64(&cs->deaf, 1);
+            }
+        }
+        fence_acquire(); // entries are read before generation
+        if (sub->generation == g) { break; }
+    }
+    // deaf clients are not reaped here: process exit watches do that
+    const uint64_t end = stats.now();
+    volatile shared_stream_stats_t* ss = &s.stats->streams[stream];
+    volatile shared_stream_t* st = streams.at(s.shared_memory, stream);
+    const int32_t position = st->position;
+    if (position >= 0) { // frame timestamp to all subscribers woken
+        const int ix = (position + st->depth - 1) % st->depth;
+        const uint64_t written = streams.frame(st, ix)->timestamp;
+        const uint64_t now = clocks.ticks(&s.shared_memory->clock);
+        const uint64_t latency = now > written ? clocks.ns(&s.shared_memory->clock, now - written) : 0;
+        counter_add64(&ss->latency_ns, latency);
+        counter_max64(&ss->latency_max_ns, latency);
+    }
+    // gauges of the last notify(): plain stores, the last writer wins
+    const uint64_t last = ss->last_ns;
+    ss->interval_ns = last != 0 && start > last ? start - last : 0;
+    ss->last_ns = start;
+    ss->subscribers = n;
+    ss->deaf_last = deaf;
+    counter_add64(&ss->wakes, n);
+    counter_add64(&ss->deaf, deaf);
+    counter_add64(&ss->notify_ns, end - start);
+    counter_add64(&ss->published, 1);
 }
 
-static void notify() {
-    lock();
-    s.deaf_count = 0;
-    for (int i = 0; i < s.client_count; i++) {
-        if (s.clients[i].running > 0) {
-            int r = events.wait_or_timeout(s.clients[i].notification, 0);
-            s.deaf_count += (r == 0); // event was not heard
-            events.set(s.clients[i].notification);
+static uint64_t slowest(int stream) {
+    // same lock free walk as notify(): cursors are written by clients
+    assert(0 <= stream && stream < (int)s.shared_memory->stream_count);
+    subscribers_t* sub = &s.subscribers[stream];
+    for (;;) {
+        const uint32_t g = sub->generation;
+        fence_acquire(); // generation is read before the entries
+        if (g & 1) { spin_pause(); continue; } // entry is being removed
+        uint64_t min = stream_no_cursor;
+        const int32_t n = sub->count;
+        fence_acquire(); // count is read before the entries it covers
+        for (int32_t i = 0; i < n; i++) {
+            const uint64_t cursor = *streams.cursor(s.shared_memory, sub->slots[i], stream);
+            if (cursor < min) { min = cursor; }
         }
+        fence_acquire(); // entries are read before generation
+        if (sub->generation == g) { return min; }
     }
-    if (s.deaf_count > 0) { threads.notify(&s.cleaner); }
-    unlock();
 }
 
 int s_rpc_start(handle_t context) {
+    const uint64_t start = stats.now();
     int r = 0;
-    lock();
-    int ix = find_client(context);
-    assert(ix >= 0);
-    if (ix < 0) {
+    registry_shard_t* sh = shard_of(context);
+    mutexes.lock(&sh->lock);
+    client_info_t* ci = find_client(sh, context);
+    assert(ci != null);
+    if (ci == null) {
         r = RPC_E_DISCONNECTED;
-    } else if (s.clients[ix].running > 0) {
+    } else if (ci->streams != 0) {
         r = SCHED_E_ALREADY_RUNNING;
     } else {
-        assert(s.clients[ix].running == 0);
-        s.clients[ix].running++;
-        assert(s.shared_memory->running >= 0);
-        s.shared_memory->running++;
-        if (s.shared_memory->running == 1) { server.start(s.shared_memory); }
+        subscribe_at(ci, all_streams());
     }
-    unlock();
+    mutexes.unlock(&sh->lock);
+    stats.call(s.shared_memory, rpc_method_start, start, r);
     return r;
 }
 
 int s_rpc_stop(handle_t context) {
+    const uint64_t start = stats.now();
     int r = 0;
-    lock();
-    int ix = find_client(context);
-    assert(ix >= 0);
-    if (ix < 0) {
+    registry_shard_t* sh = shard_of(context);
+    mutexes.lock(&sh->lock);
+    client_info_t* ci = find_client(sh, context);
+    assert(ci != null);
+    if (ci == null) {
         r = RPC_E_DISCONNECTED;
-    } else if (s.clients[ix].running == 0) {
+    } else if (ci->streams == 0) {
         r = SCHED_E_TASK_NOT_RUNNING;
     } else {
-        assert(s.clients[ix].running == 1);
-        s.clients[ix].running--;
-        assert(s.shared_memory->running > 0);
-        s.shared_memory->running--;
-        if (s.shared_memory->running == 0) { server.stop(); }
+        unsubscribe_at(ci, all_streams());
     }
-    unlock();
+    mutexes.unlock(&sh->lock);
+    stats.call(s.shared_memory, rpc_method_stop, start, r);
     return r;
 }
 
+int s_rpc_subscribe(handle_t context, rpc_uint64_t set) {
+    const uint64_t start = stats.now();
+    int r = 0;
+    registry_shard_t* sh = shard_of(context);
+    mutexes.lock(&sh->lock);
+    client_info_t* ci = find_client(sh, context);
+    assert(ci != null);
+    if (ci == null) {
+        r = RPC_E_DISCONNECTED;
+    } else if ((set & ~all_streams()) != 0) {
+        r = ERROR_INVALID_PARAMETER;
+    } else {
+        subscribe_at(ci, set);
+    }
+    mutexes.unlock(&sh->lock);
+    stats.call(s.shared_memory, rpc_method_subscribe, start, r);
+    return r;
+}
+
+int s_rpc_unsubscribe(handle_t context, rpc_uint64_t set) {
+    const uint64_t start = stats.now();
+    int r = 0;
+    registry_shard_t* sh = shard_of(context);
+    mutexes.lock(&sh->lock);
+    client_info_t* ci = find_client(sh, context);
+    assert(ci != null);
+    if (ci == null) {
+        r = RPC_E_DISCONNECTED;
+    } else if ((set & ~all_streams()) != 0) {
+        r = ERROR_INVALID_PARAMETER;
+    } else {
+        unsubscribe_at(ci, set);
+    }
+    mutexes.unlock(&sh->lock);
+    stats.call(s.shared_memory, rpc_method_unsubscribe, start, r);
+    return r;
+}
+
+static int set_value(const char* name, const char* value) {
+    assert(s.writing); // single writer for kv buckets and blob arena
+    const size_t bytes = strlen(value) + 1;
+    blob_t blob = {0};
+    blob_t previous = {0};
+    int r = 0;
+    if (bytes > kv_value_bytes) { r = blobs.put(s.shared_memory, value, bytes, &blob); }
+    if (r == 0) {
+        // new value is published before the replaced one is released
+        r = kv.set(s.shared_memory, name, value, bytes > kv_value_bytes ? &blob : null, &previous);
+        if (r != 0 && blob.bytes > 0) { blobs.release(s.shared_memory, &blob); }
+        if (r == 0 && previous.bytes > 0) { blobs.release(s.shared_memory, &previous); }
+    }
+    return r == 0 ? 0 : r == kv_too_long ? ERROR_INVALID_PARAMETER : ERROR_NOT_ENOUGH_MEMORY;
+}
+
+// lock free (same as clients): returns midl_user_allocate() copy of the
+// value or null if absent; *bytes includes zero terminator
+static char* copy_value(const char* name, int* bytes) {
+    char inline_value[kv_value_bytes];
+    for (;;) {
+        blob_t blob = {0};
+        int k = kv.get(s.shared_memory, name, inline_value, kv_value_bytes, &blob);
+        if (k != kv_oversize && k <= 0) { return null; }
+        const void* data = k > 0 ? inline_value : blobs.data(s.shared_memory, &blob);
+        const int n = k > 0 ? k : (int)blob.bytes;
+        char* value = data != null ? (char*)midl_user_allocate(n) : null;
+        if (value != null) { memcpy(value, data, n); }
+        if (k > 0 || (value != null && blobs.valid(s.shared_memory, &blob))) {
+            *bytes = n;
+            return value;
+        }
+        heap.free(value); // value has been replaced while it was copied: look it up again
+    }
+}
+
 int s_rpc_set(handle_t context, unsigned char* name, unsigned char* value) {
-    lock();
+    const uint64_t start = stats.now();
+    lock_writer();
 //  traceln("s_rpc_set(context=%p, name=\"%s\", value=\"%s\")\n", context, name, value);
-    unlock();
-    return 0;
+    int r = set_value((const char*)name, (const char*)value);
+    unlock_writer();
+    stats.call(s.shared_memory, rpc_method_set, start, r);
+    return r;
 }
 
 int s_rpc_get(handle_t context, unsigned char* name, int* bytes, unsigned char** value) {
-    lock();
-    const char* r = "Goodbye Universe";
-    *bytes = (int)strlen(r) + 1;
-    *value = (char*)midl_user_allocate(*bytes);
-    if (*value != null) { memcpy(*value, r, *bytes); }
+    // clients read kv and blob arena directly and only call here on miss
+    const uint64_t start = stats.now();
+    *bytes = 0;
+    *value = (unsigned char*)copy_value((const char*)name, bytes);
 //  traceln("s_rpc_get(context=%p, name=\"%s\", value=\"%s\")\n", context, name, *value);
-    unlock();
-    return 0;
+    const int r = *value != null ? 0 : ERROR_NOT_FOUND;
+    stats.call(s.shared_memory, rpc_method_get, start, r);
+    return r;
+}
+
+// returns pointer past the zero terminated string at p or null if it is not in [p..end)
+static const byte* next_string(const byte* p, const byte* end) {
+    const byte* z = p < end ? (const byte*)memchr(p, 0, end - p) : null;
+    return z != null ? z + 1 : null;
 }
 
+int s_rpc_set_many(handle_t context, int count, int bytes, byte* pairs) {
+    // count "name\0value\0" pairs under a single lock, stops at first error
+    const uint64_t start = stats.now();
+    int r = 0;
+    const byte* end = pairs + bytes;
+    const byte* p = pairs;
+    lock_writer();
+    for (int i = 0; i < count && r == 0; i++) {
+        const byte* value = next_string(p, end);
+        const byte* next = value != null ? next_string(value, end) : null;
+        if (next == null) {
+            r = ERROR_INVALID_PARAMETER;
+        } else {
+            r = set_value((const char*)p, (const char*)value);
+            p = next;
+        }
+    }
+    unlock_writer();
+    stats.call(s.shared_memory, rpc_method_set_many, start, r);
+    return r;
+}
+
+int s_rpc_get_many(handle_t context, int count, int bytes, byte* names,
+                   int* value_bytes, byte** values) {
+    // replies with count zero terminated values, "" for absent names
+    const uint64_t start = stats.now();
+    int r = count >= 0 ? 0 : ERROR_INVALID_PARAMETER;
+    const byte* end = names + bytes;
+    *value_bytes = 0;
+    *values = null;
+    char** copies = null;
+    int* sizes = null;
+    if (r == 0) {
+        copies = (char**)heap.alloc((count > 0 ? count : 1) * sizeof(char*));
+        sizes = (int*)heap.alloc((count > 0 ? count : 1) * sizeof(int));
+        r = copies != null && sizes != null ? 0 : ERROR_NOT_ENOUGH_MEMORY;
+    }
+    int total = 0;
+    int copied = 0;
+    const byte* p = names;
+    while (r == 0 && copied < count) { // values are copied lock free one by one
+        const byte* next = next_string(p, end);
+        if (next == null) {
+            r = ERROR_INVALID_PARAMETER;
+        } else {
+            sizes[copied] = 1;
+            copies[copied] = copy_value((const char*)p, &sizes[copied]);
+            total += sizes[copied];
+            copied++;
+            p = next;
+        }
+    }
+    if (r == 0) {
+        *values = (byte*)midl_user_allocate(total > 0 ? total : 1);
+        r = *values != null ? 0 : ERROR_NOT_ENOUGH_MEMORY;
+    }
+    if (r == 0) {
+        byte* q = *values;
+        for (int i = 0; i < count; i++) {
+            if (copies[i] != null) { memcpy(q, copies[i], sizes[i]); } else { *q = 0; }
+            q += sizes[i];
+        }
+        *value_bytes = total;
+    }
+    for (int i = 0; i < copied; i++) { heap.free(copies[i]); }
+    heap.free(sizes);
+    heap.free(copies);
+    stats.call(s.shared_memory, rpc_method_get_many, start, r);
+    return r;
+}
+
+#ifdef _WIN32
+
+void s_rpc_set_async(PRPC_ASYNC_STATE async, handle_t context, unsigned char* name, unsigned char* value) {
+    // [async] in iface.acf: call is processed synchronously, completion is
+    // what lets client keep several calls in flight
+    int r = s_rpc_set(context, name, value);
+    fatal_if_not_zero(RpcAsyncCompleteCall(async, &r));
+}
+
+#endif
+
 int s_rpc_disconnect(handle_t context, rpc_info_t* info) {
-    lock();
+    const uint64_t start = stats.now();
     remove_client(context);
-    unlock();
+    counter_add64(&s.stats->disconnects, 1);
+    stats.call(s.shared_memory, rpc_method_disconnect, start, 0);
     return 0;
 }
 
 void s_rpc_shutdown(handle_t context) {
+    stats.call(s.shared_memory, rpc_method_shutdown, stats.now(), 0);
     s.shutdown = true;
     server.shutdown();
+#ifdef _WIN32
     fatal_if_not_zero(RpcMgmtStopServerListening(null));
     fatal_if_not_zero(RpcServerUnregisterIf(s_rpc_i_v1_0_s_ifspec, null, false));
+#else
+    uds.stop();
+#endif
+}
+
+typedef struct drain_s { // of one client upload ring
+    int slot;
+    volatile shared_upload_t* upload;
+    bool writing; // holds s.writer for the rest of the ring
+    bool answered; // upload_type_call records: the client waits on `replied`
+    uint64_t bytes;
+    uint64_t errors;
+} drain_t;
+
+static void upload_record(void* that, uint32_t type, const byte* data, uint32_t bytes) {
+    drain_t* d = (drain_t*)that;
+    d->bytes += bytes;
+    if (type == upload_type_set || type == upload_type_call) {
+        const uint64_t start = stats.now();
+        // client may still write the ring: parse a private copy
+        assert(bytes <= upload_max_record); // uploads.read() drops longer records
+        memcpy(s.scratch, data, bytes);
+        const byte* end = s.scratch + bytes;
+        const byte* value = next_string(s.scratch, end);
+        const byte* next = value != null ? next_string(value, end) : null;
+        int r = ERROR_INVALID_PARAMETER;
+        if (next != null) {
+            if (!d->writing) { lock_writer(); d->writing = true; } // once per ring
+            r = set_value((const char*)s.scratch, (const char*)value);
+        }
+        if (type == upload_type_set) {
+            if (r != 0) { d->errors++; }
+        } else { // the result goes back to the client instead
+            d->upload->result = r;
+            fence_release(); // result is written before it is answered
+            d->upload->answered++;
+            d->answered = true;
+            stats.call(s.shared_memory, rpc_method_set, start, r);
+        }
+    } else if (type >= upload_type_user && server.upload != null) {
+        server.upload(d->slot, type, data, bytes);
+    } else if (type < upload_type_user) {
+        d->errors++;
+    }
+}
+
+static void drain_slot(int slot) { // uploads_lock held
+    volatile shared_upload_t* u = s.upload[slot];
+    if (u == null) { return; } // client is gone, its ready bit was late
+    // full barrier: records written after rung is lowered ring the doorbell again
+    atomic_compare_exchange32(&u->rung, 1, 0);
+    drain_t d = { slot, u, false, false, 0, 0 };
+    const int n = uploads.read(u, &d, upload_record);
+    if (d.writing) { unlock_writer(); }
+    if (d.answered) { broadcasts.publish(&s.replied[slot]); }
+    counter_add64(&stats.client(s.stats, slot)->uploads, n);
+    counter_add64(&s.stats->uploads, n);
+    counter_add64(&s.stats->upload_bytes, d.bytes);
+    if (d.errors > 0) { counter_add64(&s.stats->upload_errors, d.errors); }
+}
+
+static void drain(int slot) {
+    mutexes.lock(&s.uploads_lock);
+    drain_slot(slot);
+    mutexes.unlock(&s.uploads_lock);
+}
+
+static uint32_t WINAPI drainer(void* p) {
+    // one thread for all client rings: only rings whose bit is set in the
+    // ready bitmap are visited, each doorbell covers all records since
+    thread_begin(p)
+    volatile shared_doorbell_t* db = s.doorbell_shared;
+    const int words = (int)(db->slots + 63) / 64;
+    int32_t seen = db->bell.generation;
+    for (;;) {
+        fence_acquire(); // generation is read before the bitmap
+        for (int i = 0; i < words; i++) {
+            uint64_t ready = db->ready[i] != 0 ? (uint64_t)atomic_exchange64(&db->ready[i], 0) : 0;
+            for (int b = 0; ready != 0; b++, ready >>= 1) {
+                if (ready & 1) { drain(i * 64 + b); }
+            }
+        }
+        counter_add64(&s.stats->drains, 1);
+        if (s.shutdown) { break; }
+        broadcasts.wait(&s.doorbell, &seen, forever);
+    }
+    thread_end
 }
 
 static int use_protocol_sequence_endpoint() {
     uint32_t r = 0;
     if (!s.endpoint_in_use) {
+#ifdef _WIN32
         r = RpcServerUseProtseqEpA("ncalrpc", RPC_C_LISTEN_MAX_CALLS_DEFAULT, "demo", null);
+#else
+        r = uds.listen("demo");
+#endif
         assert(r == 0 || r == RPC_S_DUPLICATE_ENDPOINT, "RpcServerUseProtseqEpA() failed %s", error_to_string(r));
         s.endpoint_in_use = r == 0;
     }
@@ -255,25 +1119,58 @@ static int use_protocol_sequence_endpoint() {
 
 static int server_listen() {
     soft_realtime_thread();
-    fatal_if_false(InitializeCriticalSectionAndSpinCount(&s.cs, 4096));
+    mutexes.init(&s.writer);
+    mutexes.init(&s.subscriptions);
+    mutexes.init(&s.slots_lock);
+    mutexes.init(&s.uploads_lock);
+    for (int i = 0; i < registry_shards; i++) { mutexes.init(&s.shards[i].lock); }
+    s.client_slots = server.client_slots();
     create_shared_memory();
+    create_registry();
+    const int workers = server.workers();
     server.notify = notify;
-    threads.create(&s.cleaner, cleaner, &s);
+    server.slowest = slowest;
+    fatal_if_null(s.scratch = (byte*)heap.alloc(upload_max_record));
+    broadcasts.init(&s.doorbell, (broadcast_shared_t*)&s.doorbell_shared->bell, null);
+    threads.create(&s.drainer, drainer, &s);
+#ifndef _WIN32
+    fatal_if_false((s.watch_set = epoll_create1(EPOLL_CLOEXEC)) >= 0);
+    threads.create(&s.watcher, watcher, &s);
+#endif
+#ifdef _WIN32
     fatal_if_not_zero(RpcServerRegisterIf2(s_rpc_i_v1_0_s_ifspec, null, null, 
                 RPC_IF_ALLOW_LOCAL_ONLY | RPC_IF_AUTOLISTEN,
-                1 /* RPC_C_LISTEN_MAX_CALLS_DEFAULT */, 1024, null)); 
-    // 1 call of 1KB incoming call maximum
+                workers, blob_arena_bytes + 64 * 1024, null)); 
+    // `workers` concurrent calls, incoming call is big enough for the largest value
 //  https://docs.microsoft.com/en-us/windows/win32/rpc/interface-registration-flags
 //  RPC_IF_AUTOLISTEN
 //      This is an auto - listen interface.The run time begins listening for calls 
 //      as soon as the first autolisten interface is registered, and stops listening 
 //      when the last autolisten interface is unregistered.
     while (!s.shutdown) {
-        fatal_if_not_zero(RpcServerListen(1, 1, true));
+        fatal_if_not_zero(RpcServerListen(1, workers, true));
         fatal_if_not_zero(RpcMgmtWaitServerListen());
     }
-    threads.join(&s.cleaner);
-    DeleteCriticalSection(&s.cs);
+#else
+    uds.disconnected = client_disconnected;
+    while (!s.shutdown) { uds.serve(workers); } // like MaxCalls above
+    s.endpoint_in_use = false;
+#endif
+#ifndef _WIN32
+    threads.join(&s.watcher);
+    close(s.watch_set);
+#endif
+    broadcasts.interrupt(&s.doorbell); // drains what is left and quits
+    threads.join(&s.drainer);
+    broadcasts.dispose(&s.doorbell);
+    heap.free(s.scratch);
+    s.scratch = null;
+    dispose_registry();
+    for (int i = 0; i < registry_shards; i++) { mutexes.dispose(&s.shards[i].lock); }
+    mutexes.dispose(&s.slots_lock);
+    mutexes.dispose(&s.uploads_lock);
+    mutexes.dispose(&s.subscriptions);
+    mutexes.dispose(&s.writer);
     return 0;
 }
 
@@ -286,56 +1183,62 @@ int server_main(int argc, const char* argv[]) {
 
 /* client */
 
+// Sessions of one process connected to the same server share a single
+// mapping of its shared memory: the handle received by a later connect()
+// is closed and the first mapping is reference counted.
+
+typedef struct client_mapping_s {
+    struct client_mapping_s* next;
+    uint64_t server_pid;
+    uint64_t bytes;
+    handle_t handle; // kept for read only view()
+    shared_memory_t* memory;
+    volatile shared_memory_t* view;
+    int32_t refs; // sessions using the mapping
+} client_mapping_t;
+
 static struct {
-    HANDLE server_thread;
-    thread_t notifier;
+    mutex_t lock; // open() and close() of sessions only
+    volatile int32_t initialized; // lock: 0 not yet, 1 being initialized, 2 ready
+    client_mapping_t* list;
+} mapped;
+
+struct session_s {
     rpc_info_t info;
-    int argc;
-    const char** argv;
-    void* context;
+    void* context; // rpc binding of this session only
+    thread_t notifier;
+    broadcast_t broadcast; // of the wake group the notifier waits on
+    mutex_t wait_lock; // notifier re-targets `broadcast`, close interrupts it
+    volatile shared_client_t* slot; // acknowledges wake generations seen
+    volatile bool quit;
     bool connected;
+    void (*notify)(session_t* s, void* that);
+    void* that;
+    client_mapping_t* mapping;
+    shared_memory_t* shared_memory; // mapping->memory
+    handle_t upload_mapping;
+    volatile shared_upload_t* upload; // written by this process only
+    broadcast_t doorbell; // of the server upload drain thread
+    mutex_t upload_lock; // single writer of the upload ring
+    broadcast_t replied; // of this ring: set() calls answered by the drain thread
+    mutex_t call_lock; // one set() waits on the ring at a time
+    uint64_t calls; // upload_type_call records written
+    int64_t submitted; // pipelined set() calls
+    int64_t completed;
+    int async_error;   // first error since last complete()
+#ifdef _WIN32
+    RPC_ASYNC_STATE async[client_max_in_flight];
+    handle_t async_events[client_max_in_flight];
+#endif
+};
+
+static struct {
+    thread_t server_thread;
     bool local; // running as local service inside same process
-    shared_memory_t* shared_memory;
+    session_t* session; // of client_if calls, opened by client.connect()
 } c;
 
-static bool connect_to_server() {
-    __try {
-        int r = c_rpc_connect(c.context, &c.info);
-        if (r == 0) {
-            assert(c.info.server_pid != 0);
-            assert(c.info.notification != 0);
-            assert(c.info.mapping != 0);
-            fatal_if_null(c.shared_memory = r != 0 ? null :
-                MapViewOfFile((handle_t)c.info.mapping, FILE_MAP_READ, 0, 0, (size_t)c.info.memory_size));
-            // handle is no longer needed after mapping succeeded
-            handles.close((handle_t)c.info.mapping);
-            c.info.mapping = 0; 
-        }
-        return r == 0;
-    } __except (1) {
-        uint32_t r = RpcExceptionCode();
-        traceln("c_rpc_connect() failed %s", error_to_string(r));
-        return false;
-    }
-}
-
-static bool disconnect_from_server() {
-    __try {
-        c_rpc_disconnect(c.context, &c.info);
-        c.connected = false;
-        return true;
-    } __except (1) {
-        uint32_t r = RpcExceptionCode();
-        traceln("c_rpc_disconnect() failed %s", error_to_string(r));
-        return false;
-    }
-}
-
-static uint32_t WINAPI run_server_main(void* p) { return server_listen(); }
-
-static void start_local_server() {
-    fatal_if_null(c.server_thread = CreateThread(null, 0, run_server_main, null, 0, null));
-}
+#ifdef _WIN32
 
 #define rpc_try_call(r, code) \
     __try {          \
@@ -345,41 +1248,251 @@ static void start_local_server() {
         traceln("%s failed %s", #code, error_to_string(r)); \
     }
 
-static void stop_local_server() {
+#else // uds.c stubs return transport errors instead of raising exceptions
+
+#define rpc_try_call(r, code) do { (void)(r); code } while (0)
+
+#endif
+
+static void mapped_lock() {
+    // sessions may be opened before anything else in the process: the
+    // first of them initializes the lock, concurrent ones wait for it
+    if (mapped.initialized != 2) {
+        if (atomic_compare_exchange32(&mapped.initialized, 0, 1)) {
+            mutexes.init(&mapped.lock);
+            fence_release(); // lock is initialized before it is ready
+            mapped.initialized = 2;
+        }
+        while (mapped.initialized != 2) { thread_yield(); }
+        fence_acquire();
+    }
+    mutexes.lock(&mapped.lock);
+}
+
+static void mapped_unlock() { mutexes.unlock(&mapped.lock); }
+
+static client_mapping_t* map_shared_memory(session_t* c) {
+    handle_t handle = (handle_t)c->info.mapping;
+    c->info.mapping = 0;
+    mapped_lock();
+    client_mapping_t* m = mapped.list;
+    while (m != null && (m->server_pid != c->info.server_pid || m->bytes != c->info.memory_size)) {
+        m = m->next;
+    }
+    if (m != null) {
+        handles.close(handle); // same server: its memory is already mapped
+    } else {
+        fatal_if_null(m = (client_mapping_t*)heap.alloc(sizeof(client_mapping_t)));
+        memset(m, 0, sizeof(*m));
+        m->server_pid = c->info.server_pid;
+        m->bytes = c->info.memory_size;
+        m->handle = handle;
+        // writable: clients acknowledge notifications in their shared_client_t slots
+        m->memory = (shared_memory_t*)mappings.map(handle, m->bytes, true);
+        assert(m->memory->directory == c->info.directory);
+        assert(m->memory->bytes <= m->bytes);
+        // structures are padded to the cache line size both sides were built with
+        fatal_if_false(m->memory->line_bytes == cache_line,
+                       "server cache_line=%u", m->memory->line_bytes);
+        if ((m->memory->options & memory_locked) && !mappings.lock(m->memory, m->bytes)) {
+            // no page faults on the first touch of frames
+            traceln("shared memory is prefaulted but not locked: %s", last_error());
+        }
+        m->next = mapped.list;
+        mapped.list = m;
+    }
+    m->refs++;
+    mapped_unlock();
+    return m;
+}
+
+static void unmap_shared_memory(client_mapping_t* m) {
+    mapped_lock();
+    const bool last = --m->refs == 0;
+    if (last) { // no other session can find it any more
+        client_mapping_t** p = &mapped.list;
+        while (*p != m) { p = &(*p)->next; }
+        *p = m->next;
+    }
+    mapped_unlock();
+    if (last) {
+        mappings.unmap(m->memory, m->bytes);
+        if (m->view != null) { mappings.unmap((void*)m->view, m->bytes); }
+        handles.close(m->handle);
+        heap.free(m);
+    }
+}
+
+// broadcasts published by the server: its events (Windows) for this process
+static void dup_parity(session_t* c, volatile uint64_t from[2], handle_t parity[2]) {
+    parity[0] = null;
+    parity[1] = null;
+#ifdef _WIN32
+    handle_t server_process = process_open((uint32_t)c->info.server_pid);
+    handle_t client_process = process_open(process_id());
+    for (int i = 0; i < 2; i++) {
+        fatal_if_null(parity[i] = handles.dup((handle_t)(uintptr_t)from[i],
+            server_process, client_process));
+    }
+    handles.close(server_process);
+    handles.close(client_process);
+#endif
+}
+
+static bool connect_to_server(session_t* c) {
+    uint32_t r = 0;
+    rpc_try_call(r, { r = c_rpc_connect(c->context, &c->info); });
+    if (r == 0) {
+        assert(c->info.server_pid != 0);
+        assert(c->info.mapping != 0);
+        c->mapping = map_shared_memory(c);
+        c->shared_memory = c->mapping->memory;
+        c->slot = streams.client(c->shared_memory, (int)c->info.slot);
+        c->upload_mapping = (handle_t)c->info.upload;
+        c->info.upload = 0;
+        c->upload = (volatile shared_upload_t*)mappings.map(c->upload_mapping,
+            sizeof(shared_upload_t), true);
+        if ((c->shared_memory->options & memory_locked) &&
+            !mappings.lock((void*)c->upload, sizeof(shared_upload_t))) {
+            traceln("upload ring is prefaulted but not locked: %s", last_error());
+        }
+        handle_t doorbell[2] = { (handle_t)c->info.doorbell[0], (handle_t)c->info.doorbell[1] };
+        broadcasts.init(&c->doorbell, (broadcast_shared_t*)&uploads.doorbell(c->shared_memory)->bell,
+                        doorbell);
+        handle_t replied[2];
+        dup_parity(c, c->upload->parity, replied);
+        broadcasts.init(&c->replied, (broadcast_shared_t*)&c->upload->replied, replied);
+        c->calls = 0;
+    }
+    return r == 0;
+}
+
+static bool disconnect_from_server(session_t* c) {
     uint32_t r = 0;
-    rpc_try_call(r, { c_rpc_shutdown(c.context); });
-    events.wait(c.server_thread);
-    handles.close(c.server_thread);
-    c.connected = false;
+    rpc_try_call(r, { r = c_rpc_disconnect(c->context, &c->info); });
+    c->connected = false;
+    return r == 0;
 }
 
-thread_proc(notifier_thread_proc, {}, {
-    void (*notify)() = client.notify;
-    if (notify != null) {
-        notify(c.shared_memory);
+static uint32_t WINAPI run_server_main(void* p) { return server_listen(); }
+
+static void start_local_server() {
+    threads.create(&c.server_thread, run_server_main, null);
+}
+
+static void stop_local_server(session_t* s) {
+    uint32_t r = 0;
+    rpc_try_call(r, { c_rpc_shutdown(s->context); });
+    threads.join(&c.server_thread);
+    s->connected = false;
+}
+
+static void wait_on(session_t* c, int32_t g) { // called with wait_lock held
+    volatile shared_group_t* gr = streams.group(c->shared_memory, g);
+    handle_t parity[2];
+    dup_parity(c, gr->parity, parity);
+    if (c->broadcast.shared != null) { broadcasts.dispose(&c->broadcast); }
+    broadcasts.init(&c->broadcast, (broadcast_shared_t*)&gr->wake, parity);
+}
+
+static uint32_t WINAPI notifier_thread_proc(void* p) {
+    soft_realtime_thread();
+    thread_begin(p)
+    session_t* c = (session_t*)that;
+    int32_t group = -1; // the notifier waits on
+    uint64_t set = 0;   // of streams of `group`
+    int32_t seen = 0;
+    while (!c->quit) {
+        const int32_t g = c->slot->group;
+        if (g >= 0 && g != group) { // server moved the client (connect, subscribe, unsubscribe)
+            fence_acquire(); // group is read before its joined generation
+            seen = c->slot->joined; // wakes up to it are for frames before the snapshot
+            set = streams.group(c->shared_memory, g)->streams;
+            mutexes.lock(&c->wait_lock);
+            wait_on(c, g);
+            const bool quit = c->quit; // close may have interrupted the previous broadcast
+            mutexes.unlock(&c->wait_lock);
+            if (quit) { break; }
+            group = g;
+            c->slot->ack = seen;
+        }
+        if (broadcasts.wait(&c->broadcast, &seen, forever)) {
+            if (c->slot->group == group) { c->slot->ack = seen; }
+            // wakes of a group the client is leaving are passed on as well:
+            // they may be for frames notified while it moved
+            if (c->notify != null && set != 0) { c->notify(c, c->that); }
+        }
     }
-}, {})
+    thread_end
+}
 
 static void client_notify(shared_memory_t* shared_memory) {
     assert(false, "must be overriden by client");
 }
 
-static int start() { uint32_t r = 0; rpc_try_call(r, { r = c_rpc_start(c.context); }); return (int)r; }
+static int session_start(session_t* c) {
+    // the server took the snapshot before it replied: no second round trip
+    uint32_t r = 0;
+    rpc_try_call(r, { r = c_rpc_start(c->context); });
+    return (int)r;
+}
 
-static int stop() { uint32_t r = 0; rpc_try_call(r, { r = c_rpc_stop(c.context); }); return (int)r; }
+static int session_stop(session_t* c) {
+    uint32_t r = 0;
+    rpc_try_call(r, { r = c_rpc_stop(c->context); });
+    return (int)r;
+}
+
+static int session_subscribe(session_t* c, uint64_t set) {
+    uint32_t r = 0;
+    rpc_try_call(r, { r = c_rpc_subscribe(c->context, set); });
+    return (int)r;
+}
 
-static int set(const char* name, const char* value) {
+static int session_unsubscribe(session_t* c, uint64_t set) {
     uint32_t r = 0;
-    rpc_try_call(r, { r = c_rpc_set(c.context, (unsigned char*)name, (unsigned char*)value); });
+    rpc_try_call(r, { r = c_rpc_unsubscribe(c->context, set); });
     return (int)r;
 }
 
-static const char* get(const char* name) {
+static int call_set(session_t* c, const char* name, const char* value);
+
+static int session_set(session_t* c, const char* name, const char* value) {
+    // through the upload ring if the record fits and there is room for it
+    int r = c->connected ? call_set(c, name, value) : upload_too_long;
+    if (r == upload_full || r == upload_too_long) {
+        rpc_try_call(r, { r = (int)c_rpc_set(c->context, (unsigned char*)name, (unsigned char*)value); });
+    }
+    return r;
+}
+
+// lock free read from shared memory: returns number of bytes copied,
+// kv_miss or kv_oversize if value does not fit into capacity
+static int read_value(session_t* c, const char* name, char* value, uint32_t capacity) {
+    blob_t blob;
+    for (;;) {
+        int k = kv.get(c->shared_memory, name, value, capacity, &blob);
+        if (k != kv_oversize || blob.bytes == 0) { return k; }
+        if (blob.bytes > capacity) { return kv_oversize; }
+        const void* data = blobs.data(c->shared_memory, &blob);
+        if (data != null) {
+            memcpy(value, data, blob.bytes);
+            if (blobs.valid(c->shared_memory, &blob)) { return (int)blob.bytes; }
+        }
+        // value has been replaced while it was being read: look it up again
+    }
+}
+
+static const char* session_get(session_t* c, const char* name) {
     static thread_local char val[1024];
+    // rpc only on miss
+    int k = read_value(c, name, val, countof(val));
+    if (k > 0) { return val; }
+    if (k == kv_oversize) { return ""; } // use get_blob() for large values
     int bytes = 0;
     char* value = null;
     uint32_t r = 0;
-    rpc_try_call(r, { r = c_rpc_get(c.context, "foo", &bytes, &value); });
+    rpc_try_call(r, { r = c_rpc_get(c->context, (unsigned char*)name, &bytes, (unsigned char**)&value); });
     if (r == 0 && bytes > countof(val) - 1) {
         r = ERROR_INSUFFICIENT_BUFFER;
     } else {
@@ -390,43 +1503,498 @@ static const char* get(const char* name) {
     return r == 0 ? val : "";
 }
 
-static void shutdown_sever() {
+static const void* session_get_blob(session_t* c, const char* name, blob_t* blob) {
+    char value[kv_value_bytes];
+    for (;;) {
+        int k = kv.get(c->shared_memory, name, value, sizeof(value), blob);
+        if (k != kv_oversize) { memset(blob, 0, sizeof(*blob)); return null; }
+        const void* data = blobs.data(c->shared_memory, blob);
+        if (data != null) { return data; }
+    }
+}
+
+static bool session_blob_valid(session_t* c, const blob_t* blob) {
+    return blob->bytes > 0 && blobs.valid(c->shared_memory, blob);
+}
+
+static bool session_read_next(session_t* c, int stream, void* data, uint32_t capacity, frame_info_t* info) {
+    volatile uint64_t* cursor = streams.cursor(c->shared_memory, (int)c->info.slot, stream);
+    volatile shared_stream_t* st = streams.at(c->shared_memory, stream);
+    // cursor is reset by the server on subscribe and unsubscribe,
+    // reading begins right after the snapshot taken on subscribe
+    if (*cursor == stream_no_cursor) { *cursor = *streams.snapshot(c->shared_memory, (int)c->info.slot, stream); }
+    return streams.next(st, cursor, data, capacity, info);
+}
+
+static bool session_snapshot(session_t* c, int stream, void* data, uint32_t capacity, frame_info_t* info) {
+    volatile shared_stream_t* st = streams.at(c->shared_memory, stream);
+    const uint64_t sequence = *streams.snapshot(c->shared_memory, (int)c->info.slot, stream);
+    memset(info, 0, sizeof(*info));
+    info->sequence = sequence;
+    if (sequence == 0) { return false; } // stream had no frames yet
+    uint64_t timestamp = 0;
+    uint64_t seq = 0;
+    const uint32_t bytes = frames.read(streams.frame(st, (int)(sequence % st->depth)), data, capacity,
+                                       &timestamp, &seq);
+    if (seq == sequence) {
+        info->timestamp = timestamp;
+        info->bytes = bytes;
+        return true;
+    }
+    // the ring has moved on since the snapshot
+    volatile shared_journal_t* j = streams.journal(st);
+    return j != null && journals.read(j, sequence, data, capacity, info);
+}
+
+// packs n strings of a[] (interleaved with b[] if not null) zero terminated
+static int pack_strings(int n, const char* a[], const char* b[], byte** buffer, int* bytes) {
+    size_t total = 0;
+    for (int i = 0; i < n; i++) {
+        total += strlen(a[i]) + 1 + (b != null ? strlen(b[i]) + 1 : 0);
+    }
+    if (total > INT32_MAX) { return ERROR_INSUFFICIENT_BUFFER; }
+    fatal_if_null(*buffer = (byte*)heap.alloc(total > 0 ? total : 1));
+    byte* p = *buffer;
+    for (int i = 0; i < n; i++) {
+        size_t k = strlen(a[i]) + 1;
+        memcpy(p, a[i], k);
+        p += k;
+        if (b != null) {
+            k = strlen(b[i]) + 1;
+            memcpy(p, b[i], k);
+            p += k;
+        }
+    }
+    *bytes = (int)total;
+    return 0;
+}
+
+static int session_set_many(session_t* c, int n, const char* names[], const char* values[]) {
+    byte* pairs = null;
+    int bytes = 0;
+    uint32_t r = pack_strings(n, names, values, &pairs, &bytes);
+    if (r == 0) {
+        rpc_try_call(r, { r = c_rpc_set_many(c->context, n, bytes, pairs); });
+    }
+    heap.free(pairs);
+    return (int)r;
+}
+
+static int session_get_many(session_t* c, int n, const char* names[], const char* values[],
+                            char* buffer, int bytes) {
+    // hits are read lock free from shared memory, all misses in one rpc call
+    int used = 0;
+    int misses = 0;
+    const char** missing = null;
+    fatal_if_null(missing = (const char**)heap.alloc((n > 0 ? n : 1) * sizeof(const char*)));
     uint32_t r = 0;
-    rpc_try_call(r, { c_rpc_shutdown(c.context); });
+    for (int i = 0; i < n && r == 0; i++) {
+        values[i] = null;
+        int k = read_value(c, names[i], buffer + used, (uint32_t)(bytes - used));
+        if (k > 0) {
+            values[i] = buffer + used;
+            used += k;
+        } else if (k == kv_miss) {
+            missing[misses++] = names[i];
+        } else {
+            r = ERROR_INSUFFICIENT_BUFFER;
+        }
+    }
+    byte* packed = null;
+    int packed_bytes = 0;
+    byte* replies = null;
+    int reply_bytes = 0;
+    if (r == 0 && misses > 0) { r = pack_strings(misses, missing, null, &packed, &packed_bytes); }
+    if (r == 0 && misses > 0) {
+        rpc_try_call(r, { r = c_rpc_get_many(c->context, misses, packed_bytes, packed,
+                                             &reply_bytes, &replies); });
+    }
+    if (r == 0 && misses > 0 && reply_bytes > bytes - used) { r = ERROR_INSUFFICIENT_BUFFER; }
+    if (r == 0 && misses > 0) {
+        memcpy(buffer + used, replies, reply_bytes);
+        const char* v = buffer + used;
+        for (int i = 0; i < n; i++) {
+            if (values[i] == null) {
+                values[i] = v;
+                v += strlen(v) + 1;
+            }
+        }
+    }
+    heap.free(replies);
+    heap.free(packed);
+    heap.free((void*)missing);
+    return (int)r;
 }
 
-static int client_connect() {
-    c.local = use_protocol_sequence_endpoint() == 0;
-    if (c.local) { start_local_server(); }
-    memset(&c.info, 0, sizeof(c.info));
-    c.info.client_pid = GetCurrentProcessId();
-    c.info.notification = (rpc_uint64_t)CreateEventA(null, FALSE, FALSE, null);
-    fatal_if_not_zero(RpcBindingFromStringBinding("ncalrpc:[demo]", &c_rpc_i_v1_0_c_ifspec));
-    c.context = c_rpc_i_v1_0_c_ifspec;
-    c.connected = connect_to_server();
+static void complete_one(session_t* c) {
+    assert(c->completed < c->submitted);
+    int reply = 0;
+    uint32_t r = 0;
+#ifdef _WIN32
+    RPC_ASYNC_STATE* a = &c->async[c->completed % client_max_in_flight];
+    events.wait(a->u.hEvent);
+    r = RpcAsyncCompleteCall(a, &reply);
+#else
+    r = c_rpc_complete(c->context, &reply);
+#endif
+    c->completed++;
+    if (r == 0) { r = reply; }
+    if (r != 0 && c->async_error == 0) { c->async_error = (int)r; }
+}
+
+static int session_submit_set(session_t* c, const char* name, const char* value) {
+    if (c->submitted - c->completed == client_max_in_flight) { complete_one(c); }
+    uint32_t r = 0;
+#ifdef _WIN32
+    const int i = (int)(c->submitted % client_max_in_flight);
+    RPC_ASYNC_STATE* a = &c->async[i];
+    if (c->async_events[i] == null) { c->async_events[i] = events.create(); }
+    fatal_if_not_zero(RpcAsyncInitializeHandle(a, sizeof(*a)));
+    a->UserInfo = null;
+    a->NotificationType = RpcNotificationTypeEvent;
+    a->u.hEvent = c->async_events[i];
+    rpc_try_call(r, { c_rpc_set_async(a, c->context, (unsigned char*)name, (unsigned char*)value); });
+#else
+    r = c_rpc_set_submit(c->context, (unsigned char*)name, (unsigned char*)value);
+#endif
+    if (r == 0) { c->submitted++; }
+    if (r != 0 && c->async_error == 0) { c->async_error = (int)r; }
+    return (int)r;
+}
+
+static int session_complete(session_t* c) {
+    while (c->completed < c->submitted) { complete_one(c); }
+    int r = c->async_error;
+    c->async_error = 0;
+    return r;
+}
+
+static void ring_doorbell(session_t* c) {
+    // only the first record since the server started draining the ring
+    // wakes it, the rest are drained with it. Always a locked instruction:
+    // head must be visible before rung is read (server lowers rung, then reads head)
+    if (atomic_compare_exchange32(&c->upload->rung, 0, 1)) {
+        const int slot = (int)c->info.slot;
+        atomic_or64(&uploads.doorbell(c->shared_memory)->ready[slot / 64], 1ULL << (slot % 64));
+        broadcasts.publish(&c->doorbell);
+    }
+}
+
+static int session_upload(session_t* c, uint32_t type, const void* data, uint32_t bytes) {
+    if (!c->connected) { return ERROR_NOT_CONNECTED; }
+    if (type == upload_type_padding) { return ERROR_INVALID_PARAMETER; }
+    mutexes.lock(&c->upload_lock);
+    const int k = uploads.write(c->upload, type, data, bytes);
+    mutexes.unlock(&c->upload_lock);
+    if (k == 0) { ring_doorbell(c); }
+    return k;
+}
+
+static int upload_pair(session_t* c, uint32_t type, const char* name, const char* value) {
+    const size_t n = strlen(name) + 1;
+    const size_t bytes = n + strlen(value) + 1;
+    if (bytes > upload_max_record) { return upload_too_long; }
+    byte stack[1024];
+    byte* pair = stack;
+    if (bytes > sizeof(stack)) { fatal_if_null(pair = (byte*)heap.alloc(bytes)); }
+    memcpy(pair, name, n);
+    memcpy(pair + n, value, bytes - n);
+    int r = session_upload(c, type, pair, (uint32_t)bytes);
+    if (pair != stack) { heap.free(pair); }
+    return r;
+}
+
+static int session_upload_set(session_t* c, const char* name, const char* value) {
+    return upload_pair(c, upload_type_set, name, value);
+}
+
+static int call_set(session_t* c, const char* name, const char* value) {
+    // the drain thread applies the record in ring order and publishes
+    // `replied`: a futex wake each way, no control transport round trip
+    mutexes.lock(&c->call_lock);
+    volatile shared_upload_t* u = c->upload;
+    int32_t seen = c->replied.shared->generation;
+    int r = upload_pair(c, upload_type_call, name, value);
+    if (r == 0) {
+        const uint64_t call = ++c->calls;
+        const double deadline = seconds_since_boot() + 3.0;
+        while (u->answered < call && r == 0) {
+            if (!broadcasts.wait(&c->replied, &seen, 100) && seconds_since_boot() > deadline) {
+                r = ERROR_TIMEOUT;
+            }
+        }
+        fence_acquire(); // answered is read before result
+        if (r == 0) { r = u->result; }
+    }
+    mutexes.unlock(&c->call_lock);
+    return r;
+}
+
+static int session_flush(session_t* c) {
+    // uploads are drained in order: wait for the server to pass current head
+    if (!c->connected) { return ERROR_NOT_CONNECTED; }
+    const uint64_t head = c->upload->head;
+    const double deadline = seconds_since_boot() + 3.0;
+    for (int spins = 0; c->upload->tail < head; spins++) {
+        if (spins < 1024) {
+            spin_pause();
+        } else if (seconds_since_boot() < deadline) {
+            thread_yield(); // drain thread may share this core
+        } else {
+            return ERROR_TIMEOUT;
+        }
+    }
+    return 0;
+}
+
+static volatile shared_memory_t* session_memory(session_t* c) {
+    return c->connected ? c->shared_memory : null;
+}
+
+static volatile shared_memory_t* session_view(session_t* c) {
+    // second mapping without write access for observers (rpc stats),
+    // shared by the sessions of the same server as the first one
+    if (!c->connected) { return null; }
+    client_mapping_t* m = c->mapping;
+    mapped_lock();
+    if (m->view == null) {
+        m->view = (volatile shared_memory_t*)mappings.map(m->handle, m->bytes, false);
+    }
+    mapped_unlock();
+    return m->view;
+}
+
+static int session_open(session_t** session, void (*notify)(session_t* s, void* that), void* that) {
+    session_t* c = null;
+    fatal_if_null(c = (session_t*)heap.alloc(sizeof(session_t)));
+    memset(c, 0, sizeof(*c));
+    c->info.client_pid = process_id();
+    c->notify = notify;
+    c->that = that;
+    mutexes.init(&c->upload_lock);
+    mutexes.init(&c->call_lock);
+    mutexes.init(&c->wait_lock);
+#ifdef _WIN32
+    fatal_if_not_zero(RpcBindingFromStringBinding("ncalrpc:[demo]", &c->context));
+#else
+    c->context = uds.bind("demo");
+#endif
+    c->connected = connect_to_server(c);
     int retry = 4;
-    while (!c.connected && retry > 0) {
+    while (!c->connected && retry > 0) {
         sleep(0.001); // yield to let server start
-        c.connected = connect_to_server();
+        c->connected = connect_to_server(c);
         retry--;
     }
-    assert(c.connected);
-    if (c.connected) {
-        threads.create_with_event(&c.notifier, notifier_thread_proc, &c, (handle_t)c.info.notification);
+    if (c->connected) {
+        threads.create(&c->notifier, notifier_thread_proc, c);
+    } else {
+        mutexes.dispose(&c->upload_lock);
+        mutexes.dispose(&c->call_lock);
+        mutexes.dispose(&c->wait_lock);
+#ifdef _WIN32
+        RpcBindingFree(&c->context);
+#else
+        uds.unbind(c->context);
+#endif
+        heap.free(c);
+        c = null;
     }
-    return c.connected ? 0 : ERROR_NOT_CONNECTED;
+    *session = c;
+    return c != null ? 0 : ERROR_NOT_CONNECTED;
 }
 
-static int client_disconnect() {
-    if (c.connected) {
-        disconnect_from_server();
+static int close_session(session_t* c, bool shutdown_local) {
+    session_complete(c); // pipelined calls must not outlive the binding
+    if (c->connected) {
+        disconnect_from_server(c);
     }
-    threads.join(&c.notifier);
-    fatal_if_false(UnmapViewOfFile(c.shared_memory));
+    c->quit = true;
+    mutexes.lock(&c->wait_lock);
+    if (c->broadcast.shared != null) { broadcasts.interrupt(&c->broadcast); }
+    mutexes.unlock(&c->wait_lock);
+    threads.join(&c->notifier);
+    if (c->broadcast.shared != null) { broadcasts.dispose(&c->broadcast); }
+    mutexes.dispose(&c->wait_lock);
+    unmap_shared_memory(c->mapping);
+    c->mapping = null;
+    c->shared_memory = null;
+    broadcasts.dispose(&c->doorbell);
+    broadcasts.dispose(&c->replied);
+    mappings.unmap((void*)c->upload, sizeof(shared_upload_t));
+    c->upload = null;
+    handles.close(c->upload_mapping);
+    c->upload_mapping = null;
+    mutexes.dispose(&c->upload_lock);
+    mutexes.dispose(&c->call_lock);
     // stop_local_server() still needs rpc binding context to call shutdown
-    if (c.local) { stop_local_server(); }
-    fatal_if_not_zero(RpcBindingFree(&c.context));
-    c.context = null;
+    if (shutdown_local) { stop_local_server(c); }
+#ifdef _WIN32
+    fatal_if_not_zero(RpcBindingFree(&c->context));
+    for (int i = 0; i < client_max_in_flight; i++) {
+        if (c->async_events[i] != null) { events.dispose(c->async_events[i]); }
+    }
+#else
+    uds.unbind(c->context);
+#endif
+    heap.free(c);
+    return 0;
+}
+
+static int session_close(session_t* c) { return close_session(c, false); }
+
+sessions_if sessions = {
+    session_open,
+    session_close,
+    session_memory,
+    session_view,
+    session_start,
+    session_stop,
+    session_subscribe,
+    session_unsubscribe,
+    session_set,
+    session_get,
+    session_get_blob,
+    session_blob_valid,
+    session_read_next,
+    session_snapshot,
+    session_set_many,
+    session_get_many,
+    session_submit_set,
+    session_complete,
+    session_upload,
+    session_upload_set,
+    session_flush
+};
+
+// client_if: the session opened by client.connect()
+
+static void notify_client(session_t* s, void* that) {
+    void (*notify)() = client.notify;
+    if (notify != null) { notify(s->shared_memory); }
+}
+
+static int start() { return session_start(c.session); }
+
+static int stop() { return session_stop(c.session); }
+
+static int subscribe(uint64_t set) { return session_subscribe(c.session, set); }
+
+static int unsubscribe(uint64_t set) { return session_unsubscribe(c.session, set); }
+
+static int set(const char* name, const char* value) { return session_set(c.session, name, value); }
+
+static const char* get(const char* name) { return session_get(c.session, name); }
+
+static const void* get_blob(const char* name, blob_t* blob) {
+    return session_get_blob(c.session, name, blob);
+}
+
+static bool blob_valid(const blob_t* blob) { return session_blob_valid(c.session, blob); }
+
+static bool read_next(int stream, void* data, uint32_t capacity, frame_info_t* info) {
+    return session_read_next(c.session, stream, data, capacity, info);
+}
+
+static bool snapshot(int stream, void* data, uint32_t capacity, frame_info_t* info) {
+    return session_snapshot(c.session, stream, data, capacity, info);
+}
+
+static int set_many(int n, const char* names[], const char* values[]) {
+    return session_set_many(c.session, n, names, values);
+}
+
+static int get_many(int n, const char* names[], const char* values[], char* buffer, int bytes) {
+    return session_get_many(c.session, n, names, values, buffer, bytes);
+}
+
+static int submit_set(const char* name, const char* value) {
+    return session_submit_set(c.session, name, value);
+}
+
+static int complete() { return session_complete(c.session); }
+
+static int upload(uint32_t type, const void* data, uint32_t bytes) {
+    return session_upload(c.session, type, data, bytes);
+}
+
+static int upload_set(const char* name, const char* value) {
+    return session_upload_set(c.session, name, value);
+}
+
+static int flush() { return session_flush(c.session); }
+
+static volatile shared_memory_t* view() {
+    return c.session != null ? session_view(c.session) : null;
+}
+
+static struct {
+    volatile shared_memory_t* memory;
+    uint64_t bytes;
+} observer;
+
+static volatile shared_memory_t* attach() {
+    // binding is only used for the one call: the mapping outlives it
+    assert(observer.memory == null);
+    void* context = null;
+#ifdef _WIN32
+    fatal_if_not_zero(RpcBindingFromStringBinding("ncalrpc:[demo]", &context));
+#else
+    context = uds.bind("demo");
+#endif
+    rpc_info_t info;
+    memset(&info, 0, sizeof(info));
+    info.client_pid = process_id();
+    uint32_t r = 0;
+    rpc_try_call(r, { r = c_rpc_view(context, &info); });
+#ifdef _WIN32
+    fatal_if_not_zero(RpcBindingFree(&context));
+#else
+    uds.unbind(context);
+#endif
+    if (r != 0) {
+        traceln("no server is listening on \"demo\": %s", error_to_string(r));
+        return null;
+    }
+    volatile shared_memory_t* m = (volatile shared_memory_t*)mappings.map((handle_t)info.mapping,
+        info.memory_size, false);
+    handles.close((handle_t)info.mapping);
+    if (m == null) {
+        traceln("cannot map server shared memory: %s", last_error());
+        return null;
+    }
+    if (m->line_bytes != cache_line) {
+        traceln("server cache_line=%u, this build %u", m->line_bytes, cache_line);
+        mappings.unmap((void*)m, info.memory_size);
+        return null;
+    }
+    observer.memory = m;
+    observer.bytes = info.memory_size;
+    return m;
+}
+
+static void detach() {
+    if (observer.memory != null) { mappings.unmap((void*)observer.memory, observer.bytes); }
+    observer.memory = null;
+    observer.bytes = 0;
+}
+
+static void shutdown_sever() {
+    uint32_t r = 0;
+    rpc_try_call(r, { c_rpc_shutdown(c.session->context); });
+}
+
+static int client_connect() {
+    c.local = use_protocol_sequence_endpoint() == 0;
+    if (c.local) { start_local_server(); }
+    const int r = session_open(&c.session, notify_client, null);
+    assert(r == 0);
+    return r;
+}
+
+static int client_disconnect() {
+    if (c.session != null) { close_session(c.session, c.local); }
+    c.session = null;
     return 0;
 }
 
@@ -436,12 +2004,28 @@ client_if client = {
     null, // notify
     start,
     stop,
+    subscribe,
+    unsubscribe,
     set,
     get,
+    get_blob,
+    blob_valid,
+    read_next,
+    snapshot,
+    set_many,
+    get_many,
+    submit_set,
+    complete,
+    upload,
+    upload_set,
+    flush,
     client_connect,
     client_test,
     client_disconnect,
-    shutdown_sever
+    shutdown_sever,
+    view,
+    attach,
+    detach
 };
 
 end_c
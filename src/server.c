@@ -1,5 +1,7 @@
 #include "win64s.h"
 #include "server.h"
+#include "recording.h"
+#include "journal.h"
 
 begin_c
 
@@ -8,62 +10,174 @@ static thread_t test;
 static volatile bool running;
 extern bool verbose;
 
+static stream_descriptor_t topology[max_streams] = {
+    { "1Hz", 4096 - sizeof(shared_frame_t), 26, 1.0 },
+    { "2Hz", 4096 - sizeof(shared_frame_t), 26, 2.0 }
+};
+
+static int stream_count = 2;
+
+static char stream_names[max_streams][32]; // storage for --stream names
+
+static int workers; // --workers rpc dispatch threads, 0: one per processor
+
+static int client_slots = 4096; // --clients
+
+static bool backpressure; // --backpressure: never lap lossless readers
+
+static memory_options_t memory = { false, false, -1, null }; // --large-pages --lock-memory --numa --memory-file
+
+static uint64_t journal_bytes; // --journal MB: default for streams without their own
+
+static const char* replay_path; // --replay: publish recorded frames instead of test letters
+
+static double replay_speed = 1.0; // --speed: of replay relative to the recording
+
 static uint32_t WINAPI test_thread_proc(void* p) {
     soft_realtime_thread();
     thread_begin(p)
-    double start_time = seconds_since_boot();
-    int k = 0;
+    volatile shared_clock_t* clock = &sm->clock;
+    const uint64_t start_time = clocks.ticks(clock);
+    const int n = (int)sm->stream_count;
+    uint64_t next[max_streams];   // ticks of the next frame for each stream
+    uint64_t period[max_streams]; // ticks between frames
+    uint32_t capacity = 0;
+    for (int i = 0; i < n; i++) {
+        next[i] = start_time;
+        period[i] = (uint64_t)(clock->ticks_per_second / streams.directory(sm, i)->rate);
+        uint32_t c = streams.directory(sm, i)->frame_bytes;
+        capacity = c > capacity ? c : capacity;
+    }
+    byte* block = null;
+    fatal_if_null(block = (byte*)heap.alloc(capacity));
+    uint32_t timeout = 0;
     for (;;) {
-        thread_wait_or_break(1000);
-        // check if there are clients that requested streams to be running:
-        if (sm->running > 0) {
-            for (int i = 0; i < countof(sm->streams); i++) {
-                volatile shared_stream_t* st = &sm->streams[i];
-                // stream[0] is 1Hz stream, stream[1] is 2Hz stream
-                if (k % (i + 1) == 0) {
-                    int ix = st->position < 0 ? 0 : st->position;
-                    char base = rand() > RAND_MAX / 2 ? 'a' : 'A';
-                    byte data = (byte)((rand() % 26) + base);
-                    st->frames[ix].data[0] = data;
-                    st->frames[ix].timestamp = seconds_since_boot();
-                    st->frames[ix].mc++;
-                    st->position = (ix + 1) % countof(st->frames);
-                    server.notify();
-                    // uncommenting trace below severely affects latency measurements
-                    if (verbose) {
-                        traceln("%s %6.3f stream[%d].frames[%02d].data:= 0x%02X '%c' (mc=%d)",
-                            timestamp_string(), st->frames[ix].timestamp - start_time,
-                            i, ix, data, data, st->frames[ix].mc);
-                    }
+        thread_wait_or_break(timeout);
+        uint64_t now = clocks.ticks(clock);
+        uint64_t earliest = now + clock->ticks_per_second; // check for start() at least once a second
+        // only streams with subscribers are produced:
+        for (int i = 0; i < n; i++) {
+            volatile shared_stream_t* st = streams.at(sm, i);
+            const uint64_t slowest = backpressure && st->running > 0 ? server.slowest(i) : stream_no_cursor;
+            if (slowest != stream_no_cursor && st->sequence - slowest >= st->depth - 1 && next[i] <= now) {
+                // next frame would lap the slowest lossless reader: hold it back
+                next[i] = now + clock->ticks_per_second / 1000;
+            } else if (st->running > 0 && next[i] <= now) {
+                volatile shared_frame_t* f = streams.frame(st, (int)((st->sequence + 1) % st->depth));
+                char base = rand() > RAND_MAX / 2 ? 'a' : 'A';
+                byte data = (byte)((rand() % 26) + base);
+                // variable size "sensor block" filled with the same letter
+                // so the reader can tell a torn frame from a good one
+                uint32_t bytes = 1 + (uint32_t)rand() % f->capacity;
+                memset(block, data, bytes);
+                const uint64_t sequence = streams.publish(st, block, bytes, clocks.ticks(clock));
+                server.notify(i);
+                // uncommenting trace below severely affects latency measurements
+                if (verbose) {
+                    traceln("%s %6.3f stream[%d].frames[%02d].data:= 0x%02X '%c' bytes=%d (seq=%llu)",
+                        timestamp_string(), clocks.ns(clock, f->timestamp - start_time) / 1e9,
+                        i, (int)(sequence % st->depth), data, data, bytes, (unsigned long long)sequence);
                 }
+                next[i] += period[i];
+                if (next[i] < now) { next[i] = now + period[i]; } // fell behind
+            } else if (st->running == 0) {
+                next[i] = now;
             }
+            if (st->running > 0 && next[i] < earliest) { earliest = next[i]; }
         }
-        k++;
+        now = clocks.ticks(clock);
+        timeout = earliest <= now ? 0 : (uint32_t)((clocks.ns(clock, earliest - now) + 500000) / 1000000);
     }
+    heap.free(block);
     thread_end
 }
 
-static int start(shared_memory_t* m) {
-    // called when shared_memory.running has been changed to none zero
+static uint32_t WINAPI replay_thread_proc(void* p) {
+    // publishes the recording at its original inter-arrival times divided
+    // by replay_speed, over and over; frames of streams without
+    // subscribers are skipped, the timeline goes on
+    soft_realtime_thread();
+    thread_begin(p)
+    volatile shared_clock_t* clock = &sm->clock;
+    recording_t r;
+    fatal_if_false(recordings.open(&r, replay_path), "%s", replay_path);
+    int map[max_streams]; // recorded stream index -> server stream index or -1
+    for (int i = 0; i < max_streams; i++) {
+        map[i] = -1;
+        for (int j = 0; j < (int)sm->stream_count && i < (int)r.header.stream_count; j++) {
+            if (strcmp(r.header.names[i], (const char*)streams.directory(sm, j)->name) == 0) { map[i] = j; }
+        }
+    }
+    const recording_frame_t* f = recordings.next(&r);
+    uint64_t origin = nanoseconds_since_boot(); // when the first frame of a pass is due
+    uint64_t first = f != null ? f->ns : 0;
+    int64_t passes = 0;
+    uint32_t timeout = 0;
+    for (;;) {
+        thread_wait_or_break(timeout);
+        timeout = 1000;
+        uint64_t now = nanoseconds_since_boot();
+        while (f != null) {
+            // recordings are in time order; older ones may have frames a
+            // little earlier than the first of the pass: due at once
+            const int64_t since = (int64_t)(f->ns - first);
+            const uint64_t due = origin + (since > 0 ? (uint64_t)(since / replay_speed) : 0);
+            const int i = f->stream < max_streams ? map[f->stream] : -1;
+            volatile shared_stream_t* st = i >= 0 ? streams.at(sm, i) : null;
+            const uint64_t slowest = backpressure && st != null && st->running > 0 ?
+                server.slowest(i) : stream_no_cursor;
+            if (due > now) {
+                // sleep whole milliseconds, spin through the last one
+                timeout = (uint32_t)((due - now) / (1000 * 1000));
+                break;
+            } else if (slowest != stream_no_cursor && st->sequence - slowest >= st->depth - 1) {
+                origin += 1000 * 1000; // hold the timeline back for the slowest lossless reader
+                timeout = 1;
+                break;
+            } else if (st != null && st->running > 0) {
+                const uint32_t capacity = streams.directory(sm, i)->frame_bytes;
+                const uint32_t bytes = f->bytes < capacity ? f->bytes : capacity;
+                streams.publish(st, f + 1, bytes, clocks.ticks(clock));
+                server.notify(i);
+            }
+            f = recordings.next(&r);
+        }
+        if (f == null) { // next pass starts after the period of the last one
+            recordings.rewind(&r);
+            f = recordings.next(&r);
+            origin = now;
+            first = f != null ? f->ns : 0;
+            timeout = f != null ? 0 : 1000; // empty recording: nothing to wait for
+            passes++;
+            if (verbose) { traceln("replay pass %lld of %s", (long long)passes, replay_path); }
+        }
+    }
+    recordings.close(&r);
+    thread_end
+}
+
+static int start(shared_memory_t* m, int stream) {
+    // called when stream.running has been changed to none zero
     if (sm == null) {
         sm = m;
-        for (int i = 0; i < countof(sm->streams); i++) { sm->streams[i].position = -1; }
     } else {
         assert(sm == m, "change in shared memory location is not supported yet");
     }
+    // position is left alone: a producer that has not seen running drop
+    // to zero yet may still be publishing and late joiners read from it
     if (test.thread == null) {
-        threads.create(&test, test_thread_proc, null);
+        if (replay_path != null) { sm->options |= memory_replayed; }
+        threads.create(&test, replay_path != null ? replay_thread_proc : test_thread_proc, null);
     }
     threads.notify(&test);
-    traceln("-- started");
+    traceln("-- started \"%s\"", streams.directory(sm, stream)->name);
     return 0;
 }
 
-static int stop() { 
-    // called when shared_memory.running has been changed to zero
-    for (int i = 0; i < countof(sm->streams); i++) { sm->streams[i].position = -1; }
-    threads.notify(&test); 
-    traceln("-- stopped");
+static int stop(int stream) {
+    // called when stream.running has been changed to zero
+    threads.notify(&test);
+    traceln("-- stopped \"%s\"", streams.directory(sm, stream)->name);
     return 0;
 }
 
@@ -75,12 +189,398 @@ static const char* get(const char* name) {
     return 0;
 }
 
+static void upload(int slot, uint32_t type, const byte* data, uint32_t bytes) {
+    if (verbose) { traceln("client[%d] upload type %u bytes=%u", slot, type, bytes); }
+}
+
 static void server_shutdown() {
     if (test.thread != null) { threads.join(&test); }
 }
 
+static int configure(int argc, const char* argv[]) {
+    if (option(argc, argv, "--backpressure")) { backpressure = true; }
+    if (option(argc, argv, "--large-pages")) { memory.large_pages = true; }
+    if (option(argc, argv, "--lock-memory")) { memory.lock = true; }
+    int n = 0;
+    for (int i = 1; i < argc - 1; i++) { // --stream is repeatable
+        if (strcmp(argv[i], "--stream") == 0) {
+            if (n == max_streams) {
+                traceln("too many --stream options, maximum is %d", max_streams);
+                return E2BIG;
+            }
+            stream_descriptor_t* d = &topology[n];
+            double mb = -1; // journal MB, -1: --journal
+            int k = sscanf(argv[i + 1], "%31[^:]:%u:%u:%lf:%lf", stream_names[n],
+                           &d->frame_bytes, &d->depth, &d->rate, &mb);
+            if (k < 4 || d->frame_bytes == 0 || d->depth < 2 || d->rate <= 0 || (k == 5 && mb < 0)) {
+                traceln("invalid --stream %s expected name:frame_bytes:depth:rate[:journal_MB]", argv[i + 1]);
+                return EINVAL;
+            }
+            d->journal_bytes = k == 5 ? (uint64_t)(mb * 1024 * 1024) : UINT64_MAX;
+            d->name = stream_names[n];
+            n++;
+            i++;
+        }
+    }
+    const char* s = null;
+    if ((s = option_value(argc, argv, "--clients")) != null) {
+        client_slots = atoi(s);
+        if (client_slots < 1) {
+            traceln("invalid --clients %s expected maximum number of clients", s);
+            return EINVAL;
+        }
+    }
+    if ((s = option_value(argc, argv, "--numa")) != null) {
+        memory.numa_node = atoi(s);
+        if (memory.numa_node < 0 || s[0] < '0' || s[0] > '9') {
+            traceln("invalid --numa %s expected node number", s);
+            return EINVAL;
+        }
+    }
+    if ((s = option_value(argc, argv, "--journal")) != null) {
+        const double mb = atof(s);
+        if (mb <= 0) {
+            traceln("invalid --journal %s expected MB of history per stream", s);
+            return EINVAL;
+        }
+        journal_bytes = (uint64_t)(mb * 1024 * 1024);
+    }
+    if ((s = option_value(argc, argv, "--memory-file")) != null) { memory.file = s; }
+    if ((s = option_value(argc, argv, "--replay")) != null) {
+        recording_t r;
+        if (!recordings.open(&r, s)) {
+            traceln("invalid --replay %s expected recording (see rpc record)", s);
+            return ENOENT;
+        }
+        recordings.close(&r);
+        replay_path = s;
+    }
+    if ((s = option_value(argc, argv, "--speed")) != null) {
+        replay_speed = atof(s);
+        if (replay_speed <= 0) {
+            traceln("invalid --speed %s expected multiple of recorded rate", s);
+            return EINVAL;
+        }
+    }
+    if ((s = option_value(argc, argv, "--workers")) != null) {
+        workers = atoi(s);
+        if (workers < 1) {
+            traceln("invalid --workers %s expected number of threads", s);
+            return EINVAL;
+        }
+    }
+    if (n > 0) { stream_count = n; }
+    for (int i = 0; i < stream_count; i++) { // UINT64_MAX: journal size was not given
+        if (i >= n || topology[i].journal_bytes == UINT64_MAX) { topology[i].journal_bytes = journal_bytes; }
+    }
+    return 0;
+}
+
+static int get_topology(const stream_descriptor_t** table) {
+    *table = topology;
+    return stream_count;
+}
+
+static int get_workers() {
+    return workers > 0 ? workers : processors_count();
+}
+
+static int get_client_slots() { return client_slots; }
+
+static const memory_options_t* get_memory() { return &memory; }
+
 int server_main(int argc, const char* argv[]);
 
+static void frames_write(volatile shared_frame_t* f, const void* data, uint32_t bytes,
+                         uint64_t timestamp, uint64_t sequence) {
+    assert(bytes <= f->capacity);
+    const uint32_t version = f->begin + 1;
+    f->begin = version;
+    fence_release(); // begin is visible before any of the frame modifications
+    f->bytes = bytes;
+    f->timestamp = timestamp;
+    f->sequence = sequence;
+    memcpy((void*)f->data, data, bytes);
+    fence_release(); // frame is complete before end is visible
+    f->end = version;
+}
+
+static uint32_t frames_read(volatile shared_frame_t* f, void* data, uint32_t capacity,
+                            uint64_t* timestamp, uint64_t* sequence) {
+    for (;;) {
+        const uint32_t end = f->end;
+        fence_acquire(); // end is read before the frame
+        const uint32_t bytes = f->bytes;
+        const uint64_t ts = f->timestamp;
+        const uint64_t seq = f->sequence;
+        uint32_t n = bytes < capacity ? bytes : capacity;
+        if (n > f->capacity) { n = f->capacity; } // torn `bytes`
+        memcpy(data, (const void*)f->data, n);
+        fence_acquire(); // frame is read before begin
+        if (f->begin == end) {
+            *timestamp = ts;
+            *sequence = seq;
+            return bytes;
+        }
+        spin_pause(); // writer is in the middle of modifying the frame
+    }
+}
+
+frames_if frames = {
+    frames_write,
+    frames_read
+};
+
+static void clocks_calibrate(shared_clock_t* c) {
+    if (!cycles_invariant()) {
+        c->cycles = 0;
+        c->ticks_per_second = 1000 * 1000 * 1000;
+        c->ticks = nanoseconds_since_boot();
+        c->ns = c->ticks;
+        return;
+    }
+    // each clock read is bracketed by two cycle reads and paired with their middle
+    const uint64_t t0 = cycles();
+    const uint64_t ns0 = nanoseconds_since_boot();
+    const uint64_t t1 = cycles();
+    sleep(0.05);
+    const uint64_t t2 = cycles();
+    const uint64_t ns1 = nanoseconds_since_boot();
+    const uint64_t t3 = cycles();
+    c->cycles = 1;
+    c->ticks = t2 + (t3 - t2) / 2;
+    c->ns = ns1;
+    c->ticks_per_second = (c->ticks - (t0 + (t1 - t0) / 2)) * 1000 * 1000 * 1000 / (ns1 - ns0);
+}
+
+static uint64_t clocks_ticks(const volatile shared_clock_t* c) {
+    return c->cycles ? cycles() : nanoseconds_since_boot();
+}
+
+static uint64_t clocks_ns(const volatile shared_clock_t* c, uint64_t ticks) {
+    const uint64_t f = c->ticks_per_second; // split: ticks * 1e9 overflows after seconds
+    return ticks / f * 1000 * 1000 * 1000 + ticks % f * 1000 * 1000 * 1000 / f;
+}
+
+clocks_if clocks = {
+    clocks_calibrate,
+    clocks_ticks,
+    clocks_ns
+};
+
+#define align_line(n) (((n) + cache_line - 1) & ~(uint64_t)(cache_line - 1))
+
+static uint32_t streams_stride(uint32_t frame_bytes) { // frames never share cache lines
+    return (uint32_t)align_line(sizeof(shared_frame_t) + (uint64_t)frame_bytes);
+}
+
+static uint64_t streams_row(int n) { // cursors (snapshots) of one client slot, padded to cache line
+    return align_line(n * sizeof(uint64_t)) / sizeof(uint64_t);
+}
+
+static uint64_t streams_size(const stream_descriptor_t* table, int n, int clients) {
+    uint64_t bytes = align_line(sizeof(shared_memory_t) + n * sizeof(shared_directory_t));
+    for (int i = 0; i < n; i++) {
+        bytes += sizeof(shared_stream_t) + (uint64_t)table[i].depth * streams_stride(table[i].frame_bytes);
+    }
+    bytes += clients * sizeof(shared_client_t) + wake_groups(clients) * sizeof(shared_group_t) +
+             2 * (uint64_t)clients * streams_row(n) * sizeof(uint64_t); // cursors and snapshots
+    for (int i = 0; i < n; i++) { // cold history after everything hot
+        bytes += align_line(journals.size(table[i].frame_bytes, table[i].journal_bytes));
+    }
+    return bytes;
+}
+
+static void streams_layout(shared_memory_t* m, const stream_descriptor_t* table, int n,
+                           int clients) {
+    m->stream_count = n;
+    m->directory = sizeof(shared_memory_t);
+    m->kv = 0;
+    m->blobs = 0;
+    m->stats = 0;
+    m->line_bytes = cache_line;
+    clocks.calibrate(&m->clock);
+    uint64_t offset = align_line(sizeof(shared_memory_t) + n * sizeof(shared_directory_t));
+    for (int i = 0; i < n; i++) {
+        const stream_descriptor_t* t = &table[i];
+        assert(strlen(t->name) < sizeof(((shared_directory_t*)null)->name), "%s", t->name);
+        volatile shared_directory_t* d = streams.directory(m, i);
+        strncpy((char*)d->name, t->name, sizeof(d->name) - 1);
+        d->frame_bytes = t->frame_bytes;
+        d->depth = t->depth;
+        d->rate = t->rate;
+        d->offset = offset;
+        assert(offset % cache_line == 0);
+        volatile shared_stream_t* st = streams.at(m, i);
+        st->position = -1;
+        st->depth = t->depth;
+        st->stride = streams_stride(t->frame_bytes);
+        st->running = 0;
+        st->journal = 0;
+        st->sequence = 0;
+        st->reserved = 0;
+        for (int j = 0; j < (int)st->depth; j++) {
+            streams.frame(st, j)->capacity = t->frame_bytes;
+        }
+        offset += sizeof(shared_stream_t) + (uint64_t)st->depth * st->stride;
+    }
+    m->client_slots = clients;
+    m->clients = offset;
+    memset((byte*)m + m->clients, 0, clients * sizeof(shared_client_t));
+    m->groups = m->clients + clients * sizeof(shared_client_t);
+    memset((byte*)m + m->groups, 0, wake_groups(clients) * sizeof(shared_group_t));
+    m->cursors = m->groups + wake_groups(clients) * sizeof(shared_group_t);
+    volatile uint64_t* cursors = (volatile uint64_t*)((byte*)m + m->cursors);
+    for (uint64_t i = 0; i < clients * streams_row(n); i++) { cursors[i] = stream_no_cursor; }
+    m->snapshots = m->cursors + (uint64_t)clients * streams_row(n) * sizeof(uint64_t);
+    memset((byte*)m + m->snapshots, 0, (uint64_t)clients * streams_row(n) * sizeof(uint64_t));
+    offset = m->snapshots + (uint64_t)clients * streams_row(n) * sizeof(uint64_t);
+    for (int i = 0; i < n; i++) {
+        const uint64_t bytes = journals.size(table[i].frame_bytes, table[i].journal_bytes);
+        if (bytes > 0) {
+            volatile shared_stream_t* st = streams.at(m, i);
+            st->journal = (int64_t)(offset - streams.directory(m, i)->offset);
+            journals.layout(streams.journal(st), table[i].frame_bytes, table[i].journal_bytes);
+            offset += align_line(bytes);
+        }
+    }
+    m->bytes = offset;
+    assert(m->bytes == streams_size(table, n, clients));
+}
+
+static volatile shared_directory_t* streams_directory(volatile shared_memory_t* m, int i) {
+    assert(0 <= i && i < (int)m->stream_count);
+    return (volatile shared_directory_t*)((byte*)m + m->directory) + i;
+}
+
+static volatile shared_stream_t* streams_at(volatile shared_memory_t* m, int i) {
+    return (volatile shared_stream_t*)((byte*)m + streams_directory(m, i)->offset);
+}
+
+static volatile shared_stream_t* streams_find(volatile shared_memory_t* m, const char* name) {
+    for (int i = 0; i < (int)m->stream_count; i++) {
+        if (strcmp((const char*)streams_directory(m, i)->name, name) == 0) { return streams_at(m, i); }
+    }
+    return null;
+}
+
+static volatile shared_journal_t* streams_journal(volatile shared_stream_t* st) {
+    return st->journal == 0 ? null : (volatile shared_journal_t*)((byte*)st + st->journal);
+}
+
+static volatile shared_frame_t* streams_frame(volatile shared_stream_t* st, int ix) {
+    assert(0 <= ix && ix < (int)st->depth);
+    return (volatile shared_frame_t*)((byte*)st + sizeof(shared_stream_t) + (uint64_t)ix * st->stride);
+}
+
+static volatile shared_client_t* streams_client(volatile shared_memory_t* m, int slot) {
+    assert(0 <= slot && slot < (int)m->client_slots);
+    return (volatile shared_client_t*)((byte*)m + m->clients) + slot;
+}
+
+static volatile shared_group_t* streams_group(volatile shared_memory_t* m, int g) {
+    assert(0 <= g && g < wake_groups((int)m->client_slots));
+    return (volatile shared_group_t*)((byte*)m + m->groups) + g;
+}
+
+static volatile uint64_t* streams_cursor(volatile shared_memory_t* m, int slot, int stream) {
+    assert(0 <= slot && slot < (int)m->client_slots);
+    assert(0 <= stream && stream < (int)m->stream_count);
+    return (volatile uint64_t*)((byte*)m + m->cursors) + (uint64_t)slot * streams_row(m->stream_count) + stream;
+}
+
+static volatile uint64_t* streams_snapshot(volatile shared_memory_t* m, int slot, int stream) {
+    assert(0 <= slot && slot < (int)m->client_slots);
+    assert(0 <= stream && stream < (int)m->stream_count);
+    return (volatile uint64_t*)((byte*)m + m->snapshots) + (uint64_t)slot * streams_row(m->stream_count) + stream;
+}
+
+static void wait_for_sequence(volatile shared_stream_t* st, uint64_t sequence) {
+    // preceding producers are in the middle of a frame copy: spin a little,
+    // then let them run (they may have been preempted on this core)
+    for (int spins = 0; st->sequence < sequence; spins++) {
+        if (spins < 64) { spin_pause(); } else { thread_yield(); }
+    }
+    fence_acquire(); // sequence is read before the slot is reused
+}
+
+static uint64_t streams_publish(volatile shared_stream_t* st, const void* data, uint32_t bytes,
+                                uint64_t timestamp) {
+    const uint64_t sequence = (uint64_t)atomic_add64(&st->reserved, 1);
+    const int ix = (int)(sequence % st->depth);
+    // slot still belongs to frame sequence - depth until it is committed
+    if (sequence > st->depth) { wait_for_sequence(st, sequence - st->depth); }
+    frames.write(streams_frame(st, ix), data, bytes, timestamp, sequence);
+    wait_for_sequence(st, sequence - 1); // commit in sequence order
+    if (st->journal != 0) { journals.append(streams_journal(st), data, bytes, timestamp, sequence); }
+    st->position = (ix + 1) % st->depth;
+    fence_release(); // frame is complete before it is counted
+    st->sequence = sequence;
+    return sequence;
+}
+
+static bool streams_next(volatile shared_stream_t* st, volatile uint64_t* cursor,
+                         void* data, uint32_t capacity, frame_info_t* info) {
+    uint64_t read = *cursor; // last sequence read
+    info->overrun = 0;
+    for (;;) {
+        const uint64_t last = st->sequence;
+        fence_acquire(); // sequence is read before the frames it covers
+        if (read >= last) { return false; }
+        // frames older than `oldest` have been or are being overwritten
+        const uint64_t reserved = st->reserved;
+        const uint64_t oldest = reserved + 1 > st->depth ? reserved + 1 - st->depth : 1;
+        volatile shared_journal_t* j = read + 1 < oldest ? streams_journal(st) : null;
+        if (j != null) { // continue from the history behind the ring
+            uint64_t first = 0;
+            uint64_t appended = 0;
+            journals.range(j, &first, &appended);
+            if (read + 1 < first) {
+                info->overrun += first - (read + 1);
+                read = first - 1;
+            }
+            const uint64_t overrun = info->overrun;
+            if (read + 1 < oldest) {
+                if (journals.read(j, read + 1, data, capacity, info)) {
+                    info->overrun = overrun;
+                    *cursor = info->sequence;
+                    return true;
+                }
+                continue; // overwritten while it was copied: the journal has moved on
+            }
+        }
+        if (read + 1 < oldest) {
+            info->overrun += oldest - (read + 1);
+            read = oldest - 1;
+        }
+        uint64_t sequence = 0;
+        info->bytes = frames.read(streams_frame(st, (int)((read + 1) % st->depth)), data,
+                                  capacity, &info->timestamp, &sequence);
+        if (sequence == read + 1) {
+            info->sequence = sequence;
+            *cursor = sequence;
+            return true;
+        }
+        // producer lapped the reader while it was copying: skip ahead again
+    }
+}
+
+streams_if streams = {
+    streams_size,
+    streams_layout,
+    streams_directory,
+    streams_at,
+    streams_find,
+    streams_frame,
+    streams_client,
+    streams_group,
+    streams_cursor,
+    streams_snapshot,
+    streams_publish,
+    streams_next,
+    streams_journal
+};
+
 server_if server = {
     null, // notify
     start,
@@ -88,7 +588,14 @@ server_if server = {
     set,
     get,
     server_main,
-    server_shutdown
+    server_shutdown,
+    configure,
+    get_topology,
+    get_workers,
+    get_client_slots,
+    get_memory,
+    null, // slowest
+    upload
 };
 
 end_c
@@ -3,32 +3,237 @@
 
 begin_c
 
-typedef struct shared_data_s {
-    volatile uint32_t mc; // modification count
-    double timestamp;     // seconds since boot
-    char data[1];
-} shared_data_t;
+enum { max_streams = 64 }; // stream sets are uint64_t bitmasks of stream indices
 
+#define stream_no_cursor UINT64_MAX // client does not read the stream losslessly
+
+// Frames are seqlock protected: writer increments `begin`, modifies
+// the frame and then sets `end` to `begin`. Reader reads `end`, copies
+// the frame and re-reads `begin`; begin != end means torn read and retry.
+
+typedef struct shared_frame_s {
+    volatile uint32_t begin; // writer incremented before modifying frame
+    volatile uint32_t end;   // writer sets to begin when frame is complete
+    uint32_t bytes;          // number of valid bytes in data[]
+    uint32_t capacity;       // number of bytes allocated for data[]
+    uint64_t timestamp;      // clocks.ticks() of the server (see shared_clock_t)
+    uint64_t sequence;       // of the frame in its stream, 0 if never written
+    byte data[];             // payload
+} shared_frame_t;
+
+// Frame with sequence k (1, 2, 3 ...) lives in frames[k % depth]. Producers
+// (threads or processes) reserve sequences with atomic increment of
+// `reserved`, write their frames concurrently and commit them in sequence
+// order, so `sequence` never runs ahead of a frame that is not complete.
+// Frames (reserved - depth .. sequence] can be read; older slots are being
+// overwritten. A producer that dies between reserve and commit stalls the
+// stream for the others.
+//
+// Fields are grouped by writer, each group on its own cache line: readers
+// polling `sequence` are not invalidated by producers contending on
+// `reserved`, nor do either invalidate the read mostly `depth` and `stride`.
+// Frames start on cache line boundaries and stride is a multiple of it,
+// so no two frames (or a frame and the stream header) share a line.
 typedef struct shared_stream_s {
-    volatile int32_t position; // next data index will be written by the server
-    shared_data_t frames[26];  // position == -1 before start / after stop
+    uint32_t depth;             // number of frames in the ring
+    uint32_t stride;            // bytes from one frame to the next
+    volatile int32_t running;   // number of subscribed clients
+    uint32_t reserved0;
+    int64_t journal;            // offset of shared_journal_t (see journal.h) from the stream, 0: none
+    uint32_t padding0[cache_line / 4 - 6];
+    volatile uint64_t sequence; // of the last committed frame, never reset
+    volatile int32_t position;  // next data index will be written by the server
+    uint32_t padding1[cache_line / 4 - 3];
+    volatile uint64_t reserved; // last sequence claimed by a producer
+    uint64_t padding2[cache_line / 8 - 1];
+    // followed by `depth` frames; position == -1 before the first frame,
+    // not reset by start and stop so it never moves back under a reader
 } shared_stream_t;
 
+typedef struct shared_directory_s { // one entry per stream
+    char name[32];
+    uint32_t frame_bytes;  // payload capacity of each frame
+    uint32_t depth;        // number of frames in the ring
+    double rate;           // frames per second
+    uint64_t offset;       // of shared_stream_t from the start of shared_memory_t
+} shared_directory_t;
+
+// Clients subscribed to the same set of streams share one wake group:
+// notify() of a stream publishes each group whose set contains it once,
+// one syscall however many clients are in the group. Group 0 is the
+// empty set of the clients that are not subscribed to anything.
+typedef struct shared_group_s { // one cache line per group
+    broadcast_shared_t wake;   // generation is incremented by notify() of the group's streams
+    volatile uint64_t streams; // written by server: set of streams of the members
+    volatile uint64_t parity[2]; // (Windows) server's wake events, members duplicate them
+    volatile int32_t members;  // written by server: 0 for a free group
+    uint32_t reserved;
+    byte padding[cache_line - 40];
+} shared_group_t;
+
+// every client in a group of its own while one of them moves into a new one, and group 0
+#define wake_groups(clients) ((clients) + 2)
+
+typedef struct shared_client_s { // one cache line per connected client
+    volatile int32_t group;   // written by server: wake group the client waits on, -1: none
+    volatile int32_t ack;     // written by client: last generation of its group it has seen
+    volatile uint64_t streams; // written by server: subscribed streams bitmask
+    volatile uint32_t pid;    // written by server: 0 for a free slot
+    // written by server before `group`: generation of the group at the
+    // client's last move into it, the client waits for wakes after it
+    volatile int32_t joined;
+    byte padding[cache_line - 24];
+} shared_client_t;
+
+// Frames are stamped with raw clock ticks (one cycle counter read per
+// frame). Server calibrates ticks against nanoseconds_since_boot() once
+// and both sides convert tick differences with integer math.
+
+typedef struct shared_clock_s { // written by the server before clients connect
+    uint64_t ticks;            // clocks.ticks() at calibration
+    uint64_t ns;               // nanoseconds_since_boot() at the same moment
+    uint64_t ticks_per_second; // 1000000000 when ticks are nanoseconds
+    uint32_t cycles;           // 1: ticks are cycles(), 0: nanoseconds_since_boot()
+    uint32_t reserved;
+} shared_clock_t;
+
+enum { // shared_memory_t.options
+    memory_large_pages = 1, // backed by large pages
+    memory_locked      = 2, // prefaulted and locked: clients lock their mapping as well
+    memory_replayed    = 4  // frames are replayed from a recording (see recording.h)
+};
+
 typedef struct shared_memory_s {
-    volatile int32_t running; // number of client requested start() over stop()
-    shared_stream_t streams[2];
+    uint32_t stream_count;    // number of entries in directory
+    uint32_t client_slots;    // number of entries in clients
+    uint64_t directory;       // offset of shared_directory_t[stream_count]
+    uint64_t bytes;           // size of the laid out memory
+    uint64_t clients;         // offset of shared_client_t[client_slots]
+    uint64_t groups;          // offset of shared_group_t[wake_groups(client_slots)]
+    uint64_t cursors;         // offset of client_slots rows of stream_count last sequences read,
+                              // each row padded to cache line (see streams.cursor())
+    uint64_t snapshots;       // offset of client_slots rows of stream_count sequences at the
+                              // client's last start()/subscribe() (see streams.snapshot())
+    uint64_t kv;              // offset of shared_kv_t (see kv.h) or 0
+    uint64_t blobs;           // offset of shared_blobs_t (see kv.h) or 0
+    uint64_t stats;           // offset of shared_stats_t (see stats.h) or 0
+    uint64_t uploads;         // offset of shared_doorbell_t (see upload.h) or 0
+    shared_clock_t clock;
+    uint32_t options;         // memory_* flags
+    int32_t numa_node;        // memory is placed on, -1 if not placed
+    uint32_t line_bytes;      // cache_line the server was built with, clients must match
+    uint32_t reserved;
 } shared_memory_t;
 
+static_assertion(sizeof(shared_frame_t) <= cache_line); // header shares line with payload only
+static_assertion(sizeof(shared_frame_t) % 8 == 0);
+static_assertion(sizeof(shared_stream_t) == 3 * cache_line);
+static_assertion(offsetof(shared_stream_t, sequence) == cache_line);
+static_assertion(offsetof(shared_stream_t, reserved) == 2 * cache_line);
+static_assertion(sizeof(shared_client_t) == cache_line);
+static_assertion(sizeof(shared_group_t) == cache_line);
+
+typedef struct stream_descriptor_s {
+    const char* name;      // at most 31 characters
+    uint32_t frame_bytes;  // payload capacity of each frame
+    uint32_t depth;        // number of frames in the ring
+    double rate;           // frames per second
+    uint64_t journal_bytes; // of payload history behind the ring, 0: no journal
+} stream_descriptor_t;
+
+typedef struct memory_options_s { // of the shared memory mapping
+    bool large_pages; // back by large pages (falls back to normal pages)
+    bool lock;        // prefault and lock on server and clients
+    int numa_node;    // -1: no placement
+    const char* file; // backs the mapping (and the journals) instead of anonymous memory
+} memory_options_t;
+
 typedef struct server_if {
-    void (*notify)(); // notify all clients of new position
-    int (*start)(shared_memory_t* sm);
-    int (*stop)();
+    void (*notify)(int stream); // notify subscribers of new stream position
+    // called when stream gets its first subscriber and after the last one left
+    int (*start)(shared_memory_t* sm, int stream);
+    int (*stop)(int stream);
     int (*set)(const char* name, const char* value);
     const char* (*get)(const char* name);
     int (*main)(int argc, const char* argv[]);
     void (*shutdown)();
+    // --stream name:frame_bytes:depth:rate (repeatable) replaces default topology
+    // --workers n number of rpc dispatch threads (default: one per processor)
+    // --clients n maximum number of connected clients (default: 4096)
+    // --backpressure producer holds frames back instead of lapping lossless readers
+    // --large-pages --lock-memory --numa node placement of shared memory
+    int (*configure)(int argc, const char* argv[]);
+    int (*topology)(const stream_descriptor_t** table); // returns number of streams
+    int (*workers)(); // number of threads dispatching rpc calls concurrently
+    int (*client_slots)(); // maximum number of connected clients
+    const memory_options_t* (*memory)();
+    // lowest cursor of lossless readers of the stream, stream_no_cursor if
+    // there are none: producer may hold frames back to avoid lapping them
+    uint64_t (*slowest)(int stream);
+    // called on the upload drain thread for client records of type
+    // upload_type_user and above (see upload.h); data is only valid inside
+    void (*upload)(int slot, uint32_t type, const byte* data, uint32_t bytes);
 } server_if;
 
 extern server_if server;
 
+typedef struct frames_if {
+    // single writer per frame; bytes <= f->capacity
+    void (*write)(volatile shared_frame_t* f, const void* data, uint32_t bytes,
+                  uint64_t timestamp, uint64_t sequence);
+    // lock free consistent copy of min(f->bytes, capacity) bytes; retries torn reads
+    // returns f->bytes; sequence == 0 if frame has never been written
+    uint32_t (*read)(volatile shared_frame_t* f, void* data, uint32_t capacity,
+                     uint64_t* timestamp, uint64_t* sequence);
+} frames_if;
+
+extern frames_if frames;
+
+typedef struct clocks_if {
+    // ~50ms when cycles are invariant; rate is known to ~1e-4 so ticks
+    // are meant for intervals, not for conversion into absolute time
+    void (*calibrate)(shared_clock_t* c);
+    uint64_t (*ticks)(const volatile shared_clock_t* c);
+    uint64_t (*ns)(const volatile shared_clock_t* c, uint64_t ticks); // of a ticks difference
+} clocks_if;
+
+extern clocks_if clocks;
+
+typedef struct frame_info_s {
+    uint64_t sequence;  // of the frame in its stream
+    uint64_t timestamp; // clocks.ticks()
+    uint64_t overrun;   // frames lapped by the ring and lost right before this one
+    uint32_t bytes;     // of the frame (copied min(bytes, capacity))
+} frame_info_t;
+
+typedef struct streams_if {
+    // bytes of shared memory for streams `table` and `clients` slots
+    uint64_t (*size)(const stream_descriptor_t* table, int n, int clients);
+    void (*layout)(shared_memory_t* sm, const stream_descriptor_t* table, int n, int clients);
+    volatile shared_directory_t* (*directory)(volatile shared_memory_t* sm, int i);
+    volatile shared_stream_t* (*at)(volatile shared_memory_t* sm, int i);
+    volatile shared_stream_t* (*find)(volatile shared_memory_t* sm, const char* name); // null if absent
+    volatile shared_frame_t* (*frame)(volatile shared_stream_t* st, int ix);
+    volatile shared_client_t* (*client)(volatile shared_memory_t* sm, int slot);
+    volatile shared_group_t* (*group)(volatile shared_memory_t* sm, int g);
+    volatile uint64_t* (*cursor)(volatile shared_memory_t* sm, int slot, int stream);
+    // last sequence of the stream committed when the client in `slot`
+    // subscribed to it, 0 if there was none (written by the server only)
+    volatile uint64_t* (*snapshot)(volatile shared_memory_t* sm, int slot, int stream);
+    // any number of producers: reserves, writes and commits the next frame,
+    // waits for producers of the preceding frames to commit theirs first
+    uint64_t (*publish)(volatile shared_stream_t* st, const void* data, uint32_t bytes,
+                        uint64_t timestamp);
+    // lossless reader: copies frame *cursor + 1 or the oldest one readable if
+    // the ring has lapped the reader and advances *cursor past it;
+    // false if there is no new frame
+    bool (*next)(volatile shared_stream_t* st, volatile uint64_t* cursor,
+                 void* data, uint32_t capacity, frame_info_t* info);
+    // history behind the ring (see journal.h), null if the stream has none.
+    // next() continues from it when the ring has lapped the reader
+    volatile struct shared_journal_s* (*journal)(volatile shared_stream_t* st);
+} streams_if;
+
+extern streams_if streams;
+
 end_c
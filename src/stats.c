@@ -0,0 +1,186 @@
+#include "win64s.h"
+#include "stats.h"
+#include "client.h"
+
+begin_c
+
+static uint64_t stats_size(int clients) {
+    return sizeof(shared_stats_t) + (uint64_t)clients * sizeof(shared_client_stats_t);
+}
+
+static uint64_t stats_now() {
+    return nanoseconds_since_boot();
+}
+
+static void stats_layout(shared_memory_t* sm, uint64_t offset, int clients) {
+    assert(offset % 64 == 0 && offset >= sm->bytes);
+    shared_stats_t* st = (shared_stats_t*)((byte*)sm + offset);
+    memset(st, 0, stats_size(clients));
+    st->started_ns = stats_now();
+    st->stream_count = sm->stream_count;
+    st->client_slots = clients;
+    sm->stats = offset;
+    sm->bytes = offset + stats_size(clients);
+}
+
+static volatile shared_stats_t* stats_at(volatile shared_memory_t* sm) {
+    return sm->stats == 0 ? null : (volatile shared_stats_t*)((byte*)sm + sm->stats);
+}
+
+static volatile shared_client_stats_t* stats_client(volatile shared_stats_t* st, int slot) {
+    assert(0 <= slot && slot < (int)st->client_slots);
+    return (volatile shared_client_stats_t*)((byte*)st + sizeof(shared_stats_t)) + slot;
+}
+
+static int latency_bucket(uint64_t ns) {
+    uint64_t us = ns / 1000;
+    int i = 0;
+    while (us > 0 && i < stats_latency_buckets - 1) { us >>= 1; i++; }
+    return i;
+}
+
+static void stats_call(volatile shared_memory_t* sm, int method, uint64_t start, int result) {
+    volatile shared_stats_t* st = stats_at(sm);
+    assert(0 <= method && method < rpc_methods);
+    if (st != null) {
+        const uint64_t ns = stats_now() - start;
+        volatile shared_method_stats_t* m = &st->methods[method];
+        counter_add64(&m->calls, 1);
+        if (result != 0) { counter_add64(&m->errors, 1); }
+        counter_add64(&m->ns, ns);
+        counter_add64(&m->buckets[latency_bucket(ns)], 1);
+    }
+}
+
+static const char* method_names[rpc_methods] = {
+    "connect", "start", "stop", "set", "get", "disconnect", "shutdown",
+    "subscribe", "unsubscribe", "set_many", "get_many", "view"
+};
+
+static double per_second(uint64_t delta, uint64_t ns) {
+    return ns > 0 ? delta * 1e9 / ns : 0;
+}
+
+static double average_us(uint64_t total_ns, uint64_t n) {
+    return n > 0 ? total_ns / 1e3 / n : 0;
+}
+
+static uint64_t percentile_us(const shared_method_stats_t* now,
+                              const shared_method_stats_t* was, double p) {
+    // upper bound of the bucket
+    const uint64_t n = now->calls - was->calls;
+    if (n == 0) { return 0; }
+    const uint64_t rank = (uint64_t)(p / 100.0 * n + 0.5);
+    uint64_t seen = 0;
+    for (int i = 0; i < stats_latency_buckets; i++) {
+        seen += now->buckets[i] - was->buckets[i];
+        if (seen >= rank && seen > 0) { return 1ULL << i; }
+    }
+    return 1ULL << (stats_latency_buckets - 1);
+}
+
+static void print_stats(volatile shared_memory_t* sm, const shared_stats_t* now,
+                        const shared_stats_t* was, uint64_t elapsed) {
+    traceln("-- up %.3fs connects %llu disconnects %llu exits %llu watches %llu",
+            (stats_now() - now->started_ns) / 1e9,
+            (unsigned long long)now->connects, (unsigned long long)now->disconnects,
+            (unsigned long long)now->exits, (unsigned long long)now->watches);
+    traceln("memory %.1fMB%s%s numa node %d", sm->bytes / (1024.0 * 1024.0),
+            sm->options & memory_large_pages ? " large pages" : "",
+            sm->options & memory_locked ? " locked" : "", sm->numa_node);
+    if (now->uploads > 0 || now->upload_errors > 0) {
+        const uint64_t records = now->uploads - was->uploads;
+        const uint64_t drains = now->drains - was->drains;
+        traceln("uploads %llu %.1f/s %.1fMB/s drains %llu %.1f/s records per drain %.1f errors %llu",
+                (unsigned long long)now->uploads, per_second(records, elapsed),
+                per_second(now->upload_bytes - was->upload_bytes, elapsed) / (1024 * 1024),
+                (unsigned long long)now->drains, per_second(drains, elapsed),
+                drains > 0 ? (double)records / drains : 0, (unsigned long long)now->upload_errors);
+    }
+    for (int i = 0; i < (int)now->stream_count; i++) {
+        const shared_stream_stats_t* s = &now->streams[i];
+        const shared_stream_stats_t* w = &was->streams[i];
+        const uint64_t published = s->published - w->published;
+        traceln("stream \"%s\" published %llu %.2f/s interval %.3fms subscribers %d wakes %llu "
+                "deaf %llu (last %d) notify %.3fus latency %.3fus max %.3fus",
+                (const char*)streams.directory(sm, i)->name,
+                (unsigned long long)s->published, per_second(published, elapsed),
+                s->interval_ns / 1e6, s->subscribers,
+                (unsigned long long)s->wakes, (unsigned long long)s->deaf, s->deaf_last,
+                average_us(s->notify_ns - w->notify_ns, published),
+                average_us(s->latency_ns - w->latency_ns, published),
+                s->latency_max_ns / 1e3);
+    }
+    for (int i = 0; i < rpc_methods; i++) {
+        const shared_method_stats_t* m = &now->methods[i];
+        const shared_method_stats_t* w = &was->methods[i];
+        const uint64_t calls = m->calls - w->calls;
+        if (m->calls == 0) { continue; }
+        traceln("rpc %-11s calls %llu %.1f/s errors %llu average %.3fus p50 <%lluus p99 <%lluus",
+                method_names[i], (unsigned long long)m->calls,
+                per_second(calls, elapsed),
+                (unsigned long long)m->errors, average_us(m->ns - w->ns, calls),
+                (unsigned long long)percentile_us(m, w, 50),
+                (unsigned long long)percentile_us(m, w, 99));
+    }
+    volatile shared_stats_t* st = stats_at(sm);
+    for (int i = 0; i < (int)now->client_slots; i++) {
+        volatile shared_client_t* sc = streams.client(sm, i);
+        volatile shared_client_stats_t* cs = stats_client(st, i);
+        if (sc->pid != 0) {
+            traceln("client[%d] pid %u streams 0x%llX group %d wakes %llu deaf %llu uploads %llu", i, sc->pid,
+                    (unsigned long long)sc->streams, sc->group, (unsigned long long)cs->wakes,
+                    (unsigned long long)cs->deaf, (unsigned long long)cs->uploads);
+        }
+    }
+}
+
+static int stats_main(int argc, const char* argv[]) {
+    const char* s = option_value(argc, argv, "--interval");
+    const int interval = s != null ? atoi(s) : 0; // milliseconds, 0: print once
+    s = option_value(argc, argv, "--count");
+    const int count = s != null ? atoi(s) : (interval > 0 ? INT32_MAX : 1);
+    if (interval < 0 || count < 1) {
+        traceln("invalid --interval or --count");
+        return EINVAL;
+    }
+    volatile shared_memory_t* sm = client.attach();
+    if (sm == null) { return ENOTCONN; } // traced by attach()
+    volatile shared_stats_t* st = stats_at(sm);
+    if (st == null) {
+        traceln("server does not publish statistics");
+        client.detach();
+        return ENOENT;
+    }
+    shared_stats_t* now = null;
+    shared_stats_t* was = null;
+    fatal_if_null(now = (shared_stats_t*)heap.alloc(sizeof(shared_stats_t)));
+    fatal_if_null(was = (shared_stats_t*)heap.alloc(sizeof(shared_stats_t)));
+    memset(was, 0, sizeof(*was)); // first sample: rates since server start
+    uint64_t time = st->started_ns;
+    for (int k = 0; k < count; k++) {
+        if (k > 0) { sleep(interval / 1000.0); }
+        // counters are independent: a sample is not atomic as a whole
+        memcpy(now, (const void*)st, sizeof(*now));
+        const uint64_t t = stats_now();
+        print_stats(sm, now, was, t - time);
+        shared_stats_t* swap = was; was = now; now = swap;
+        time = t;
+    }
+    heap.free(now);
+    heap.free(was);
+    client.detach();
+    return 0;
+}
+
+stats_if stats = {
+    stats_size,
+    stats_layout,
+    stats_at,
+    stats_client,
+    stats_now,
+    stats_call,
+    stats_main
+};
+
+end_c
@@ -0,0 +1,94 @@
+#pragma once
+#include "win64s.h"
+#include "server.h"
+
+begin_c
+
+// Live server counters in shared memory next to the streams. Server
+// updates them with relaxed atomic adds (maxima with a relaxed compare
+// exchange) from rpc workers, the drain thread and every producer in
+// notify(), and never reads them back; gauges of the last event are plain
+// stores. `rpc stats` reads them from a read only view. Counters only
+// grow, readers compute rates from differences.
+
+enum {
+    stats_latency_buckets = 16 // log2 microseconds: [0..1us) [1..2us) ... [16ms..)
+};
+
+enum { // rpc_i methods (iface.idl)
+    rpc_method_connect,
+    rpc_method_start,
+    rpc_method_stop,
+    rpc_method_set,
+    rpc_method_get,
+    rpc_method_disconnect,
+    rpc_method_shutdown,
+    rpc_method_subscribe,
+    rpc_method_unsubscribe,
+    rpc_method_set_many,
+    rpc_method_get_many,
+    rpc_method_view,
+    rpc_methods
+};
+
+typedef struct shared_method_stats_s {
+    volatile uint64_t calls;
+    volatile uint64_t errors; // calls that returned non zero
+    volatile uint64_t ns;     // total time spent in the server
+    volatile uint64_t buckets[stats_latency_buckets];
+} shared_method_stats_t;
+
+typedef struct shared_stream_stats_s { // written by notify() of every producer of the stream
+    volatile uint64_t published;   // notify() calls
+    volatile uint64_t wakes;       // subscribers woken
+    volatile uint64_t deaf;        // subscribers that had not seen their previous wake
+    volatile uint64_t notify_ns;   // total time of notify() walks
+    volatile uint64_t latency_ns;  // total time from frame timestamp to the end of notify()
+    volatile uint64_t latency_max_ns;
+    // gauges, last writer wins:
+    volatile uint64_t interval_ns; // between the last two notify() calls
+    volatile uint64_t last_ns;     // stats.now() of the last notify()
+    volatile int32_t subscribers;  // woken by the last notify()
+    volatile int32_t deaf_last;    // deaf subscribers at the last notify()
+} shared_stream_stats_t;
+
+typedef struct shared_client_stats_s { // zeroed when the slot is claimed, then counters only
+    volatile uint64_t wakes;
+    volatile uint64_t deaf; // wakes published before the client saw the previous one
+    volatile uint64_t uploads; // records drained from the client's upload ring
+} shared_client_stats_t;
+
+typedef struct shared_stats_s {
+    uint64_t started_ns;       // stats.now() when the server laid out memory
+    uint32_t stream_count;
+    uint32_t client_slots;
+    volatile uint64_t connects;
+    volatile uint64_t disconnects;
+    volatile uint64_t exits;   // clients removed because their process exited
+    volatile uint64_t watches; // process exit notifications handled
+    volatile uint64_t drains;  // passes of the upload drain thread over rung rings
+    volatile uint64_t uploads; // records drained from client upload rings
+    volatile uint64_t upload_bytes;
+    volatile uint64_t upload_errors; // malformed or failed records
+    shared_method_stats_t methods[rpc_methods];
+    shared_stream_stats_t streams[max_streams];
+    // followed by shared_client_stats_t[client_slots]
+} shared_stats_t;
+
+typedef struct stats_if {
+    uint64_t (*size)(int clients);
+    void (*layout)(shared_memory_t* sm, uint64_t offset, int clients);
+    volatile shared_stats_t* (*at)(volatile shared_memory_t* sm); // null if absent
+    volatile shared_client_stats_t* (*client)(volatile shared_stats_t* st, int slot);
+    uint64_t (*now)(); // nanoseconds since boot
+    // server: records rpc call that started at stats.now() == start
+    void (*call)(volatile shared_memory_t* sm, int method, uint64_t start, int result);
+    // rpc stats [--interval milliseconds] [--count n]
+    // prints counters once or every interval (rates since previous print)
+    // from a read only client.attach(): takes no client slot
+    int (*main)(int argc, const char* argv[]);
+} stats_if;
+
+extern stats_if stats;
+
+end_c
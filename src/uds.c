@@ -0,0 +1,753 @@
+#define _GNU_SOURCE // accept4(), struct ucred
+#include "win64s.h"
+#ifndef _WIN32
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "uds.h"
+
+begin_c
+
+enum {
+    uds_op_connect,
+    uds_op_start,
+    uds_op_stop,
+    uds_op_set,
+    uds_op_get,
+    uds_op_disconnect,
+    uds_op_shutdown,
+    uds_op_subscribe,
+    uds_op_unsubscribe,
+    uds_op_set_many,
+    uds_op_get_many,
+    uds_op_view,
+    uds_op_count,
+    uds_max_message = 64 * 1024, // including header
+    uds_max_fds = 2, // file descriptors sent with one message
+    uds_channels = 16 // sockets per binding for concurrent calls
+};
+
+typedef struct uds_header_s {
+    uint32_t op;
+    int32_t  r;     // result in replies
+    uint32_t bytes; // number of payload bytes following header
+} uds_header_t;
+
+typedef struct uds_message_s {
+    uds_header_t header;
+    byte payload[uds_max_message - sizeof(uds_header_t)];
+} uds_message_t;
+
+typedef struct uds_channel_s { // one socket of a binding
+    int fd; // -1 until connected
+    mutex_t mutex; // one call at a time per channel
+    int in_flight; // submitted uds_op_set calls waiting for their replies
+    struct uds_binding_s* binding;
+    uds_message_t* message; // allocated on first call
+} uds_channel_t;
+
+typedef struct uds_binding_s { // client side context
+    struct sockaddr_un address;
+    socklen_t address_bytes;
+    // Server identifies the client by the connection of channels[0]:
+    // calls that depend on client identity always go through it, other
+    // calls made concurrently by several threads take any idle channel
+    // (like ncalrpc opens more connections for concurrent calls).
+    uds_channel_t channels[uds_channels];
+} uds_binding_t;
+
+typedef struct uds_connection_s { // server side context
+    int fd;
+    uint32_t pid; // SO_PEERCRED
+    struct uds_connection_s* next;
+    struct uds_connection_s* prev;
+} uds_connection_t;
+
+typedef struct uds_call_s {
+    uds_connection_t* connection;
+    uds_message_t* message;       // request in, reply out
+    int fds[uds_max_fds];         // received with request or -1
+    handle_t reply[uds_max_fds];  // sent with reply and closed after, null terminated
+} uds_call_t;
+
+static struct {
+    bool listening;
+    int listener;
+    int stop; // eventfd
+    int epoll;
+    mutex_t lock; // connections list
+    uds_connection_t* connections;
+} d;
+
+static socklen_t uds_address(struct sockaddr_un* a, const char* endpoint) {
+    memset(a, 0, sizeof(*a));
+    a->sun_family = AF_UNIX;
+    // abstract namespace: a->sun_path[0] == 0, no file system entry to clean up
+    const int n = (int)strlen(endpoint);
+    assert(0 < n && n < (int)sizeof(a->sun_path) - 1, "endpoint=\"%s\"", endpoint);
+    memcpy(a->sun_path + 1, endpoint, n);
+    return (socklen_t)(offsetof(struct sockaddr_un, sun_path) + 1 + n);
+}
+
+static int uds_send(int socket, uds_message_t* m, const int* fds, int n) {
+    assert(0 <= n && n <= uds_max_fds);
+    struct iovec iov = { m, sizeof(uds_header_t) + m->header.bytes };
+    struct msghdr mh = { 0 };
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    union { struct cmsghdr align; char data[CMSG_SPACE(uds_max_fds * sizeof(int))]; } control;
+    if (n > 0) {
+        memset(&control, 0, sizeof(control));
+        mh.msg_control = control.data;
+        mh.msg_controllen = CMSG_SPACE(n * sizeof(int));
+        struct cmsghdr* cm = CMSG_FIRSTHDR(&mh);
+        cm->cmsg_level = SOL_SOCKET;
+        cm->cmsg_type = SCM_RIGHTS;
+        cm->cmsg_len = CMSG_LEN(n * sizeof(int));
+        memcpy(CMSG_DATA(cm), fds, n * sizeof(int));
+    }
+    ssize_t k = 0;
+    do { k = sendmsg(socket, &mh, MSG_NOSIGNAL); } while (k < 0 && errno == EINTR);
+    return k < 0 ? errno : 0;
+}
+
+static int uds_receive(int socket, uds_message_t* m, int fds[uds_max_fds]) {
+    for (int i = 0; i < uds_max_fds; i++) { fds[i] = -1; }
+    struct iovec iov = { m, sizeof(*m) };
+    struct msghdr mh = { 0 };
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    union { struct cmsghdr align; char data[CMSG_SPACE(uds_max_fds * sizeof(int))]; } control;
+    mh.msg_control = control.data;
+    mh.msg_controllen = sizeof(control.data);
+    ssize_t k = 0;
+    do { k = recvmsg(socket, &mh, MSG_CMSG_CLOEXEC); } while (k < 0 && errno == EINTR);
+    int r = k < 0 ? errno : 0;
+    struct cmsghdr* cm = k > 0 ? CMSG_FIRSTHDR(&mh) : null;
+    if (cm != null && cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS) {
+        const size_t n = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        memcpy(fds, CMSG_DATA(cm), (n < uds_max_fds ? n : uds_max_fds) * sizeof(int));
+    }
+    if (r != 0) {
+        // keep errno
+    } else if (k == 0) {
+        r = ECONNRESET; // orderly shutdown by peer
+    } else if ((mh.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) != 0) {
+        r = EMSGSIZE;
+    } else if (k < (ssize_t)sizeof(uds_header_t) ||
+               k != (ssize_t)(sizeof(uds_header_t) + m->header.bytes)) {
+        r = EPROTO;
+    }
+    for (int i = 0; i < uds_max_fds && r != 0; i++) {
+        if (fds[i] >= 0) { close(fds[i]); fds[i] = -1; }
+    }
+    return r;
+}
+
+/* client stubs */
+
+static int uds_connect(uds_channel_t* b) {
+    int r = 0;
+    fatal_if_false((b->fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0)) >= 0);
+    if (connect(b->fd, (struct sockaddr*)&b->binding->address, b->binding->address_bytes) != 0) {
+        r = errno;
+        close(b->fd);
+        b->fd = -1;
+    }
+    return r;
+}
+
+static uds_channel_t* uds_prepare(uds_channel_t* ch) {
+    if (ch->message == null) {
+        fatal_if_null(ch->message = (uds_message_t*)heap.alloc(sizeof(uds_message_t)));
+    }
+    return ch;
+}
+
+static uds_channel_t* uds_lock(handle_t context) { // channel that identifies client
+    uds_binding_t* b = (uds_binding_t*)context;
+    mutexes.lock(&b->channels[0].mutex);
+    return uds_prepare(&b->channels[0]);
+}
+
+static uds_channel_t* uds_lock_any(handle_t context) { // for calls that do not need identity
+    uds_binding_t* b = (uds_binding_t*)context;
+    for (int i = 0; i < uds_channels; i++) {
+        if (mutexes.try_lock(&b->channels[i].mutex)) { return uds_prepare(&b->channels[i]); }
+    }
+    // all busy: wait for the channel assigned to this thread
+    static volatile int32_t threads_seen;
+    static thread_local int pick;
+    if (pick == 0) { pick = 1 + (atomic_add32(&threads_seen, 1) - 1) % (uds_channels - 1); }
+    mutexes.lock(&b->channels[pick].mutex);
+    return uds_prepare(&b->channels[pick]);
+}
+
+static void uds_unlock(uds_channel_t* b) { mutexes.unlock(&b->mutex); }
+
+static void uds_reset(uds_channel_t* b) { // reconnect on next call
+    if (b->fd >= 0) { close(b->fd); b->fd = -1; }
+    b->in_flight = 0; // replies of submitted calls are lost with the socket
+}
+
+static int uds_request(uds_channel_t* b, uint32_t op, uint32_t bytes, int fd) {
+    int r = b->fd >= 0 ? 0 : uds_connect(b);
+    if (r == 0) {
+        b->message->header.op = op;
+        b->message->header.r = 0;
+        b->message->header.bytes = bytes;
+        r = uds_send(b->fd, b->message, &fd, fd >= 0 ? 1 : 0);
+    }
+    if (r != 0) { uds_reset(b); }
+    return r;
+}
+
+// reply_fds[uds_max_fds] receives descriptors sent with the reply or -1
+static int uds_reply(uds_channel_t* b, uint32_t op, int* reply_fds) {
+    int ignore[uds_max_fds];
+    int* fds = reply_fds != null ? reply_fds : ignore;
+    int r = uds_receive(b->fd, b->message, fds);
+    if (r == 0 && b->message->header.op != op) { r = EPROTO; }
+    if (r != 0) { uds_reset(b); }
+    for (int i = 0; i < uds_max_fds && reply_fds == null; i++) {
+        if (ignore[i] >= 0) { close(ignore[i]); }
+    }
+    return r != 0 ? r : b->message->header.r;
+}
+
+// returns transport error or server side result
+static int uds_call(uds_channel_t* b, uint32_t op, uint32_t bytes, int fd, int* reply_fds) {
+    assert(b->in_flight == 0, "complete() submitted calls first");
+    for (int i = 0; i < uds_max_fds && reply_fds != null; i++) { reply_fds[i] = -1; }
+    int r = uds_request(b, op, bytes, fd);
+    return r != 0 ? r : uds_reply(b, op, reply_fds);
+}
+
+static int uds_strings(uds_channel_t* b, const char* s0, const char* s1, uint32_t* bytes) {
+    const size_t n0 = strlen(s0) + 1;
+    const size_t n1 = s1 != null ? strlen(s1) + 1 : 0;
+    if (n0 + n1 > sizeof(b->message->payload)) { return ERROR_INSUFFICIENT_BUFFER; }
+    memcpy(b->message->payload, s0, n0);
+    if (s1 != null) { memcpy(b->message->payload + n0, s1, n1); }
+    *bytes = (uint32_t)(n0 + n1);
+    return 0;
+}
+
+int c_rpc_connect(handle_t context, rpc_info_t* info) {
+    uds_channel_t* b = uds_lock(context);
+    memcpy(b->message->payload, info, sizeof(*info));
+    int fds[uds_max_fds]; // shared memory and client's upload ring
+    int r = uds_call(b, uds_op_connect, sizeof(*info), -1, fds);
+    if (r == 0 && (b->message->header.bytes != sizeof(*info) || fds[0] < 0 || fds[1] < 0)) {
+        r = EPROTO;
+    }
+    if (r == 0) {
+        memcpy(info, b->message->payload, sizeof(*info));
+        info->mapping = (rpc_uint64_t)posix_handle_import(fds[0], false);
+        info->upload = (rpc_uint64_t)posix_handle_import(fds[1], false);
+    } else {
+        for (int i = 0; i < uds_max_fds; i++) { if (fds[i] >= 0) { close(fds[i]); } }
+    }
+    uds_unlock(b);
+    return r;
+}
+
+int c_rpc_start(handle_t context) {
+    uds_channel_t* b = uds_lock(context);
+    int r = uds_call(b, uds_op_start, 0, -1, null);
+    uds_unlock(b);
+    return r;
+}
+
+int c_rpc_stop(handle_t context) {
+    uds_channel_t* b = uds_lock(context);
+    int r = uds_call(b, uds_op_stop, 0, -1, null);
+    uds_unlock(b);
+    return r;
+}
+
+int c_rpc_set(handle_t context, unsigned char* name, unsigned char* value) {
+    uds_channel_t* b = uds_lock_any(context);
+    uint32_t bytes = 0;
+    int r = uds_strings(b, (const char*)name, (const char*)value, &bytes);
+    if (r == 0) { r = uds_call(b, uds_op_set, bytes, -1, null); }
+    uds_unlock(b);
+    return r;
+}
+
+int c_rpc_get(handle_t context, unsigned char* name, int* bytes, unsigned char** value) {
+    uds_channel_t* b = uds_lock_any(context);
+    *bytes = 0;
+    *value = null;
+    uint32_t n = 0;
+    int r = uds_strings(b, (const char*)name, null, &n);
+    if (r == 0) { r = uds_call(b, uds_op_get, n, -1, null); }
+    if (r == 0) {
+        *bytes = (int)b->message->header.bytes;
+        fatal_if_null(*value = (unsigned char*)heap.alloc(*bytes));
+        memcpy(*value, b->message->payload, *bytes);
+    }
+    uds_unlock(b);
+    return r;
+}
+
+int c_rpc_view(handle_t context, rpc_info_t* info) {
+    uds_channel_t* b = uds_lock(context);
+    memcpy(b->message->payload, info, sizeof(*info));
+    int fds[uds_max_fds]; // shared memory only
+    int r = uds_call(b, uds_op_view, sizeof(*info), -1, fds);
+    if (r == 0 && (b->message->header.bytes != sizeof(*info) || fds[0] < 0)) { r = EPROTO; }
+    if (r == 0) {
+        memcpy(info, b->message->payload, sizeof(*info));
+        info->mapping = (rpc_uint64_t)posix_handle_import(fds[0], false);
+        fds[0] = -1;
+    }
+    for (int i = 0; i < uds_max_fds; i++) { if (fds[i] >= 0) { close(fds[i]); } }
+    uds_unlock(b);
+    return r;
+}
+
+int c_rpc_disconnect(handle_t context, rpc_info_t* info) {
+    uds_channel_t* b = uds_lock(context);
+    memcpy(b->message->payload, info, sizeof(*info));
+    int r = uds_call(b, uds_op_disconnect, sizeof(*info), -1, null);
+    uds_unlock(b);
+    return r;
+}
+
+void c_rpc_shutdown(handle_t context) {
+    uds_channel_t* b = uds_lock(context);
+    int r = uds_call(b, uds_op_shutdown, 0, -1, null);
+    if (r != 0) { traceln("shutdown failed %s", error_to_string(r)); }
+    uds_unlock(b);
+}
+
+static int uds_call_streams(handle_t context, uint32_t op, rpc_uint64_t streams) {
+    uds_channel_t* b = uds_lock(context);
+    memcpy(b->message->payload, &streams, sizeof(streams));
+    int r = uds_call(b, op, sizeof(streams), -1, null);
+    uds_unlock(b);
+    return r;
+}
+
+int c_rpc_subscribe(handle_t context, rpc_uint64_t streams) {
+    return uds_call_streams(context, uds_op_subscribe, streams);
+}
+
+int c_rpc_unsubscribe(handle_t context, rpc_uint64_t streams) {
+    return uds_call_streams(context, uds_op_unsubscribe, streams);
+}
+
+// count followed by `bytes` of packed zero terminated strings
+static int uds_packed(uds_channel_t* b, int count, int bytes, const byte* data, uint32_t* n) {
+    const uint32_t k = sizeof(int32_t);
+    if (count < 0 || bytes < 0) { return ERROR_INVALID_PARAMETER; }
+    if ((size_t)bytes + k > sizeof(b->message->payload)) { return ERROR_INSUFFICIENT_BUFFER; }
+    memcpy(b->message->payload, &count, k);
+    memcpy(b->message->payload + k, data, bytes);
+    *n = k + (uint32_t)bytes;
+    return 0;
+}
+
+int c_rpc_set_many(handle_t context, int count, int bytes, byte* pairs) {
+    uds_channel_t* b = uds_lock_any(context);
+    uint32_t n = 0;
+    int r = uds_packed(b, count, bytes, pairs, &n);
+    if (r == 0) { r = uds_call(b, uds_op_set_many, n, -1, null); }
+    uds_unlock(b);
+    return r;
+}
+
+int c_rpc_get_many(handle_t context, int count, int bytes, byte* names, int* value_bytes,
+                   byte** values) {
+    uds_channel_t* b = uds_lock_any(context);
+    *value_bytes = 0;
+    *values = null;
+    uint32_t n = 0;
+    int r = uds_packed(b, count, bytes, names, &n);
+    if (r == 0) { r = uds_call(b, uds_op_get_many, n, -1, null); }
+    if (r == 0) {
+        *value_bytes = (int)b->message->header.bytes;
+        fatal_if_null(*values = (byte*)heap.alloc(*value_bytes > 0 ? *value_bytes : 1));
+        memcpy(*values, b->message->payload, *value_bytes);
+    }
+    uds_unlock(b);
+    return r;
+}
+
+int c_rpc_set_submit(handle_t context, unsigned char* name, unsigned char* value) {
+    uds_channel_t* b = uds_lock(context);
+    uint32_t bytes = 0;
+    int r = uds_strings(b, (const char*)name, (const char*)value, &bytes);
+    if (r == 0) { r = uds_request(b, uds_op_set, bytes, -1); }
+    if (r == 0) { b->in_flight++; }
+    uds_unlock(b);
+    return r;
+}
+
+int c_rpc_complete(handle_t context, int* reply) {
+    uds_channel_t* b = uds_lock(context);
+    int r = b->in_flight > 0 ? 0 : ERROR_NOT_CONNECTED; // reply lost with the socket
+    if (r == 0) {
+        b->in_flight--;
+        r = uds_reply(b, uds_op_set, null);
+    }
+    *reply = r;
+    uds_unlock(b);
+    return 0;
+}
+
+static handle_t uds_bind(const char* endpoint) {
+    uds_binding_t* b = null;
+    fatal_if_null(b = (uds_binding_t*)heap.alloc(sizeof(uds_binding_t)));
+    memset(b, 0, sizeof(*b));
+    b->address_bytes = uds_address(&b->address, endpoint);
+    for (int i = 0; i < uds_channels; i++) {
+        b->channels[i].fd = -1;
+        b->channels[i].binding = b;
+        mutexes.init(&b->channels[i].mutex);
+    }
+    return b;
+}
+
+static void uds_unbind(handle_t binding) {
+    uds_binding_t* b = (uds_binding_t*)binding;
+    for (int i = 0; i < uds_channels; i++) {
+        uds_channel_t* ch = &b->channels[i];
+        if (ch->fd >= 0) { close(ch->fd); }
+        heap.free(ch->message);
+        mutexes.dispose(&ch->mutex);
+    }
+    heap.free(b);
+}
+
+/* server dispatch */
+
+static void uds_dispatch_connect(uds_call_t* call) {
+    uds_message_t* m = call->message;
+    int r = 0;
+    rpc_info_t info;
+    if (m->header.bytes != sizeof(info)) {
+        r = EPROTO;
+    } else {
+        memcpy(&info, m->payload, sizeof(info));
+        info.client_pid = call->connection->pid; // as seen by the kernel
+        r = s_rpc_connect(call->connection, &info);
+        call->reply[0] = (handle_t)info.mapping;
+        call->reply[1] = (handle_t)info.upload;
+        info.mapping = 0;
+        info.upload = 0;
+        memcpy(m->payload, &info, sizeof(info));
+    }
+    m->header.r = r;
+    m->header.bytes = r == 0 ? sizeof(info) : 0;
+}
+
+static void uds_dispatch_view(uds_call_t* call) {
+    uds_message_t* m = call->message;
+    int r = 0;
+    rpc_info_t info;
+    if (m->header.bytes != sizeof(info)) {
+        r = EPROTO;
+    } else {
+        memcpy(&info, m->payload, sizeof(info));
+        info.client_pid = call->connection->pid; // as seen by the kernel
+        r = s_rpc_view(call->connection, &info);
+        call->reply[0] = (handle_t)info.mapping;
+        info.mapping = 0;
+        memcpy(m->payload, &info, sizeof(info));
+    }
+    m->header.r = r;
+    m->header.bytes = r == 0 ? sizeof(info) : 0;
+}
+
+static void uds_dispatch_start(uds_call_t* call) {
+    call->message->header.r = s_rpc_start(call->connection);
+    call->message->header.bytes = 0;
+}
+
+static void uds_dispatch_stop(uds_call_t* call) {
+    call->message->header.r = s_rpc_stop(call->connection);
+    call->message->header.bytes = 0;
+}
+
+// returns pointer to the next zero terminated string in payload or null
+static char* uds_string(uds_message_t* m, uint32_t* offset) {
+    char* s = (char*)m->payload + *offset;
+    const uint32_t left = m->header.bytes - *offset;
+    const char* z = *offset < m->header.bytes ? memchr(s, 0, left) : null;
+    if (z != null) { *offset += (uint32_t)(z - s) + 1; }
+    return z != null ? s : null;
+}
+
+static void uds_dispatch_set(uds_call_t* call) {
+    uds_message_t* m = call->message;
+    uint32_t offset = 0;
+    char* name = uds_string(m, &offset);
+    char* value = uds_string(m, &offset);
+    m->header.r = name == null || value == null ? EPROTO :
+        s_rpc_set(call->connection, (unsigned char*)name, (unsigned char*)value);
+    m->header.bytes = 0;
+}
+
+static void uds_dispatch_get(uds_call_t* call) {
+    uds_message_t* m = call->message;
+    uint32_t offset = 0;
+    char* name = uds_string(m, &offset);
+    int bytes = 0;
+    unsigned char* value = null;
+    int r = name == null ? EPROTO :
+        s_rpc_get(call->connection, (unsigned char*)name, &bytes, &value);
+    if (r == 0 && bytes > (int)sizeof(m->payload)) { r = ERROR_INSUFFICIENT_BUFFER; }
+    if (r == 0) { memcpy(m->payload, value, bytes); }
+    heap.free(value);
+    m->header.r = r;
+    m->header.bytes = r == 0 ? (uint32_t)bytes : 0;
+}
+
+static void uds_dispatch_disconnect(uds_call_t* call) {
+    uds_message_t* m = call->message;
+    rpc_info_t info;
+    if (m->header.bytes != sizeof(info)) {
+        m->header.r = EPROTO;
+    } else {
+        memcpy(&info, m->payload, sizeof(info));
+        m->header.r = s_rpc_disconnect(call->connection, &info);
+    }
+    m->header.bytes = 0;
+}
+
+static void uds_dispatch_shutdown(uds_call_t* call) {
+    s_rpc_shutdown(call->connection);
+    call->message->header.r = 0;
+    call->message->header.bytes = 0;
+}
+
+static void uds_dispatch_streams(uds_call_t* call,
+                                 int (*proc)(handle_t context, rpc_uint64_t streams)) {
+    uds_message_t* m = call->message;
+    rpc_uint64_t streams = 0;
+    if (m->header.bytes != sizeof(streams)) {
+        m->header.r = EPROTO;
+    } else {
+        memcpy(&streams, m->payload, sizeof(streams));
+        m->header.r = proc(call->connection, streams);
+    }
+    m->header.bytes = 0;
+}
+
+static void uds_dispatch_subscribe(uds_call_t* call) {
+    uds_dispatch_streams(call, s_rpc_subscribe);
+}
+
+static void uds_dispatch_unsubscribe(uds_call_t* call) {
+    uds_dispatch_streams(call, s_rpc_unsubscribe);
+}
+
+static void uds_dispatch_set_many(uds_call_t* call) {
+    uds_message_t* m = call->message;
+    int32_t count = 0;
+    const uint32_t k = sizeof(count);
+    if (m->header.bytes < k) {
+        m->header.r = EPROTO;
+    } else {
+        memcpy(&count, m->payload, k);
+        m->header.r = s_rpc_set_many(call->connection, count, (int)(m->header.bytes - k),
+                                     m->payload + k);
+    }
+    m->header.bytes = 0;
+}
+
+static void uds_dispatch_get_many(uds_call_t* call) {
+    uds_message_t* m = call->message;
+    int32_t count = 0;
+    const uint32_t k = sizeof(count);
+    int bytes = 0;
+    byte* values = null;
+    int r = 0;
+    if (m->header.bytes < k) {
+        r = EPROTO;
+    } else {
+        memcpy(&count, m->payload, k);
+        r = s_rpc_get_many(call->connection, count, (int)(m->header.bytes - k),
+                           m->payload + k, &bytes, &values);
+    }
+    if (r == 0 && bytes > (int)sizeof(m->payload)) { r = ERROR_INSUFFICIENT_BUFFER; }
+    if (r == 0) { memcpy(m->payload, values, bytes); }
+    heap.free(values);
+    m->header.r = r;
+    m->header.bytes = r == 0 ? (uint32_t)bytes : 0;
+}
+
+static void (*const uds_dispatch_table[uds_op_count])(uds_call_t* call) = {
+    uds_dispatch_connect,
+    uds_dispatch_start,
+    uds_dispatch_stop,
+    uds_dispatch_set,
+    uds_dispatch_get,
+    uds_dispatch_disconnect,
+    uds_dispatch_shutdown,
+    uds_dispatch_subscribe,
+    uds_dispatch_unsubscribe,
+    uds_dispatch_set_many,
+    uds_dispatch_get_many,
+    uds_dispatch_view
+};
+
+static void uds_close_connection(uds_connection_t* c, bool notify) {
+    mutexes.lock(&d.lock);
+    if (c->prev != null) { c->prev->next = c->next; } else { d.connections = c->next; }
+    if (c->next != null) { c->next->prev = c->prev; }
+    mutexes.unlock(&d.lock);
+    close(c->fd); // also removes it from epoll set
+    if (notify && uds.disconnected != null) { uds.disconnected(c); }
+    heap.free(c);
+}
+
+// connections and listener are EPOLLONESHOT: exactly one worker thread
+// handles a socket until it is re-armed, so calls of one connection are
+// dispatched and replied in order
+static void uds_arm(int fd, void* ptr, int op) {
+    struct epoll_event ev = { 0 };
+    ev.events = EPOLLIN | EPOLLONESHOT;
+    ev.data.ptr = ptr;
+    fatal_if_false(epoll_ctl(d.epoll, op, fd, &ev) == 0);
+}
+
+static void uds_accept() {
+    int fd = accept4(d.listener, null, null, SOCK_CLOEXEC);
+    uds_arm(d.listener, &d.listener, EPOLL_CTL_MOD);
+    if (fd < 0) {
+        traceln("accept4() failed %s", last_error());
+        return;
+    }
+    struct ucred cred = { 0 };
+    socklen_t bytes = sizeof(cred);
+    fatal_if_false(getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &bytes) == 0);
+    if (cred.uid != getuid()) { // same as ncalrpc: only the same user account
+        traceln("rejected pid=%d uid=%d", cred.pid, cred.uid);
+        close(fd);
+        return;
+    }
+    uds_connection_t* c = null;
+    fatal_if_null(c = (uds_connection_t*)heap.alloc(sizeof(uds_connection_t)));
+    c->fd = fd;
+    c->pid = (uint32_t)cred.pid;
+    c->prev = null;
+    mutexes.lock(&d.lock);
+    c->next = d.connections;
+    if (c->next != null) { c->next->prev = c; }
+    d.connections = c;
+    mutexes.unlock(&d.lock);
+    uds_arm(fd, c, EPOLL_CTL_ADD);
+}
+
+static void uds_dispatch(uds_connection_t* c, uds_message_t* m) {
+    uds_call_t call = { c, m };
+    int r = uds_receive(c->fd, m, call.fds);
+    if (r == 0 && m->header.op >= uds_op_count) { r = EPROTO; }
+    int fds[uds_max_fds];
+    int n = 0;
+    if (r == 0) {
+        uds_dispatch_table[m->header.op](&call);
+        while (n < uds_max_fds && call.reply[n] != null) { fds[n] = posix_handle_export(call.reply[n]); n++; }
+        r = uds_send(c->fd, m, fds, n);
+    }
+    for (int i = 0; i < uds_max_fds; i++) {
+        if (call.reply[i] != null) { handles.close(call.reply[i]); }
+        if (call.fds[i] >= 0) { close(call.fds[i]); }
+    }
+    if (r != 0) {
+        if (r != ECONNRESET) { traceln("pid=%d %s", c->pid, error_to_string(r)); }
+        uds_close_connection(c, true);
+    } else {
+        uds_arm(c->fd, c, EPOLL_CTL_MOD);
+    }
+}
+
+static int uds_listen(const char* endpoint) {
+    int r = 0;
+    if (d.listening) {
+        r = RPC_S_DUPLICATE_ENDPOINT;
+    } else {
+        struct sockaddr_un a;
+        socklen_t n = uds_address(&a, endpoint);
+        fatal_if_false((d.listener = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0)) >= 0);
+        if (bind(d.listener, (struct sockaddr*)&a, n) != 0) {
+            r = errno;
+            assert(r == EADDRINUSE, "bind() failed %s", error_to_string(r));
+            close(d.listener);
+        } else {
+            fatal_if_false(listen(d.listener, SOMAXCONN) == 0);
+            fatal_if_false((d.stop = eventfd(0, EFD_CLOEXEC)) >= 0);
+            d.listening = true;
+        }
+    }
+    return r;
+}
+
+static uint32_t WINAPI uds_worker(void* p) {
+    soft_realtime_thread(); // same as the thread that called serve()
+    uds_message_t* m = null; // request and reply of the call being dispatched
+    fatal_if_null(m = (uds_message_t*)heap.alloc(sizeof(uds_message_t)));
+    bool stop = false;
+    while (!stop) {
+        struct epoll_event ev;
+        int n = epoll_wait(d.epoll, &ev, 1, -1);
+        fatal_if_false(n >= 0 || errno == EINTR);
+        if (n <= 0) {
+            // interrupted
+        } else if (ev.data.ptr == &d.listener) {
+            uds_accept();
+        } else if (ev.data.ptr == &d.stop) {
+            stop = true; // level triggered and never read: wakes all workers
+        } else {
+            uds_dispatch((uds_connection_t*)ev.data.ptr, m);
+        }
+    }
+    heap.free(m);
+    return 0;
+}
+
+static void uds_serve(int workers) {
+    assert(d.listening && workers > 0);
+    fatal_if_false((d.epoll = epoll_create1(EPOLL_CLOEXEC)) >= 0);
+    mutexes.init(&d.lock);
+    uds_arm(d.listener, &d.listener, EPOLL_CTL_ADD);
+    struct epoll_event ev = { 0 };
+    ev.events = EPOLLIN;
+    ev.data.ptr = &d.stop;
+    fatal_if_false(epoll_ctl(d.epoll, EPOLL_CTL_ADD, d.stop, &ev) == 0);
+    thread_t* pool = null;
+    fatal_if_null(pool = (thread_t*)heap.alloc(workers * sizeof(thread_t)));
+    memset(pool, 0, workers * sizeof(thread_t));
+    for (int i = 1; i < workers; i++) { threads.create(&pool[i], uds_worker, null); }
+    uds_worker(null); // calling thread is worker[0]
+    for (int i = 1; i < workers; i++) { threads.join(&pool[i]); }
+    heap.free(pool);
+    while (d.connections != null) { uds_close_connection(d.connections, false); }
+    mutexes.dispose(&d.lock);
+    close(d.epoll);
+    close(d.stop);
+    close(d.listener);
+    d.listening = false;
+}
+
+static void uds_stop() {
+    uint64_t one = 1;
+    fatal_if_false(write(d.stop, &one, sizeof(one)) == sizeof(one));
+}
+
+uds_if uds = {
+    null, // disconnected
+    uds_listen,
+    uds_serve,
+    uds_stop,
+    uds_bind,
+    uds_unbind
+};
+
+end_c
+
+#endif // _WIN32
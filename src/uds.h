@@ -0,0 +1,85 @@
+#pragma once
+#include "win64s.h"
+
+begin_c
+
+// Linux control plane transport for rpc_i interface (iface.idl) that
+// stands in for MIDL generated iface_h.h, iface_c.c and iface_s.c:
+// AF_UNIX SOCK_SEQPACKET in the abstract namespace, one message per call
+// and one per reply; memfds travel as SCM_RIGHTS ancillary data.
+// Keep rpc_info_t and the prototypes below in sync with iface.idl.
+
+typedef unsigned long long rpc_uint64_t;
+typedef int rpc_int32_t;
+
+typedef struct rpc_info_s {
+    rpc_uint64_t client_pid;   // from client before connect()
+    rpc_uint64_t server_pid;   // from server valid after connect()
+    rpc_uint64_t mapping;      // from server memory mapping valid after connect()
+    rpc_uint64_t memory_size;  // from server valid after connect()
+    rpc_uint64_t directory;    // from server offset of streams directory in mapping
+    rpc_uint64_t slot;         // from server index of client's shared_client_t
+    rpc_uint64_t upload;       // from server mapping of client's shared_upload_t valid after connect()
+    rpc_uint64_t doorbell[2];  // from server (Windows) upload doorbell parity events valid after connect()
+} rpc_info_t;
+
+int  c_rpc_connect(handle_t context, rpc_info_t* info);
+int  c_rpc_start(handle_t context);
+int  c_rpc_stop(handle_t context);
+int  c_rpc_set(handle_t context, unsigned char* name, unsigned char* value);
+int  c_rpc_get(handle_t context, unsigned char* name, int* bytes, unsigned char** value);
+int  c_rpc_disconnect(handle_t context, rpc_info_t* info);
+void c_rpc_shutdown(handle_t context);
+int  c_rpc_subscribe(handle_t context, rpc_uint64_t streams);
+int  c_rpc_unsubscribe(handle_t context, rpc_uint64_t streams);
+int  c_rpc_set_many(handle_t context, int count, int bytes, byte* pairs);
+int  c_rpc_get_many(handle_t context, int count, int bytes, byte* names, int* value_bytes, byte** values);
+// pipelined rpc_set: submit sends the call without waiting for its reply,
+// complete receives the oldest outstanding reply into *reply
+int  c_rpc_set_submit(handle_t context, unsigned char* name, unsigned char* value);
+int  c_rpc_complete(handle_t context, int* reply);
+int  c_rpc_view(handle_t context, rpc_info_t* info);
+
+int  s_rpc_connect(handle_t context, rpc_info_t* info);
+int  s_rpc_start(handle_t context);
+int  s_rpc_stop(handle_t context);
+int  s_rpc_set(handle_t context, unsigned char* name, unsigned char* value);
+int  s_rpc_get(handle_t context, unsigned char* name, int* bytes, unsigned char** value);
+int  s_rpc_disconnect(handle_t context, rpc_info_t* info);
+void s_rpc_shutdown(handle_t context);
+int  s_rpc_subscribe(handle_t context, rpc_uint64_t streams);
+int  s_rpc_unsubscribe(handle_t context, rpc_uint64_t streams);
+int  s_rpc_set_many(handle_t context, int count, int bytes, byte* pairs);
+int  s_rpc_get_many(handle_t context, int count, int bytes, byte* names, int* value_bytes, byte** values);
+int  s_rpc_view(handle_t context, rpc_info_t* info);
+
+#define midl_user_allocate(bytes) heap.alloc(bytes)
+
+// Win32 error codes reported by rpc.c mapped to errno values:
+#define ERROR_BLOCK_TOO_MANY_REFERENCES EMLINK
+#define ERROR_BUSY                      EBUSY
+#define ERROR_INSUFFICIENT_BUFFER       ENOBUFS
+#define ERROR_INVALID_PARAMETER         EINVAL
+#define ERROR_NOT_ENOUGH_MEMORY         ENOMEM
+#define ERROR_NOT_FOUND                 ENOENT
+#define ERROR_NOT_CONNECTED             ENOTCONN
+#define ERROR_TIMEOUT                   ETIMEDOUT
+#define RPC_E_DISCONNECTED              ECONNRESET
+#define RPC_S_DUPLICATE_ENDPOINT        EADDRINUSE
+#define SCHED_E_ALREADY_RUNNING         EALREADY
+#define SCHED_E_TASK_NOT_RUNNING        ESRCH
+
+typedef struct uds_if {
+    void (*disconnected)(handle_t context); // server: called when client socket closes
+    int (*listen)(const char* endpoint); // 0 or RPC_S_DUPLICATE_ENDPOINT
+    // dispatches s_rpc_*() calls on `workers` threads (including the
+    // calling one) until stop(); calls of one connection are dispatched in order
+    void (*serve)(int workers);
+    void (*stop)();
+    handle_t (*bind)(const char* endpoint); // client: connects lazily on first call
+    void (*unbind)(handle_t binding);
+} uds_if;
+
+extern uds_if uds;
+
+end_c
@@ -0,0 +1,88 @@
+#include "win64s.h"
+#include "upload.h"
+
+begin_c
+
+static uint64_t upload_record_bytes(uint32_t bytes) { // header and padded payload
+    return sizeof(upload_record_t) + ((uint64_t)bytes + 7) / 8 * 8;
+}
+
+static uint64_t uploads_size(int clients) {
+    return sizeof(shared_doorbell_t) + (uint64_t)(clients + 63) / 64 * sizeof(uint64_t);
+}
+
+static void uploads_layout(shared_memory_t* sm, uint64_t offset, int clients) {
+    assert(offset % 64 == 0 && offset >= sm->bytes);
+    shared_doorbell_t* d = (shared_doorbell_t*)((byte*)sm + offset);
+    memset(d, 0, uploads_size(clients));
+    d->slots = clients;
+    sm->uploads = offset;
+    sm->bytes = offset + uploads_size(clients);
+}
+
+static volatile shared_doorbell_t* uploads_doorbell(volatile shared_memory_t* sm) {
+    return sm->uploads == 0 ? null : (volatile shared_doorbell_t*)((byte*)sm + sm->uploads);
+}
+
+static int uploads_write(volatile shared_upload_t* u, uint32_t type, const void* data, uint32_t bytes) {
+    if (bytes > upload_max_record) { return upload_too_long; }
+    const uint64_t need = upload_record_bytes(bytes);
+    const uint64_t head = u->head; // single writer
+    const uint32_t at = (uint32_t)(head & (upload_ring_bytes - 1));
+    const uint64_t pad = at + need > upload_ring_bytes ? upload_ring_bytes - at : 0;
+    if (head + pad + need - u->tail > upload_ring_bytes) { return upload_full; }
+    fence_acquire(); // server is done with the space before it is overwritten
+    if (pad > 0) {
+        upload_record_t* r = (upload_record_t*)(u->data + at);
+        r->bytes = (uint32_t)(pad - sizeof(upload_record_t));
+        r->type = upload_type_padding;
+    }
+    upload_record_t* r = (upload_record_t*)(u->data + ((head + pad) & (upload_ring_bytes - 1)));
+    r->bytes = bytes;
+    r->type = type;
+    memcpy(r + 1, data, bytes);
+    fence_release(); // record is complete before head covers it
+    u->head = head + pad + need;
+    return 0;
+}
+
+static int uploads_read(volatile shared_upload_t* u, void* that,
+                        void (*record)(void* that, uint32_t type, const byte* data, uint32_t bytes)) {
+    const uint64_t head = u->head;
+    fence_acquire(); // head is read before the records it covers
+    uint64_t tail = u->tail; // single reader
+    int n = 0;
+    while (tail < head) {
+        const uint32_t at = (uint32_t)(tail & (upload_ring_bytes - 1));
+        const upload_record_t* r = (const upload_record_t*)(u->data + at);
+        const uint32_t bytes = r->bytes;
+        const uint32_t type = r->type;
+        const uint64_t next = tail + upload_record_bytes(bytes);
+        // only padding may be longer than a record: it fills the ring up to its end
+        const uint32_t limit = type == upload_type_padding ? upload_ring_bytes : upload_max_record;
+        if (bytes > limit || at + (next - tail) > upload_ring_bytes || next > head) {
+            traceln("corrupted upload record at %llu: %u bytes", (unsigned long long)tail, bytes);
+            record(that, upload_type_corrupt, null, 0);
+            tail = head; // cannot find the next record: drop the rest
+            break;
+        }
+        if (type != upload_type_padding) {
+            record(that, type, (const byte*)(r + 1), bytes);
+            n++;
+        }
+        tail = next;
+    }
+    fence_release(); // records are consumed before their space is handed back
+    u->tail = tail;
+    return n;
+}
+
+uploads_if uploads = {
+    uploads_size,
+    uploads_layout,
+    uploads_doorbell,
+    uploads_write,
+    uploads_read
+};
+
+end_c
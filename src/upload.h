@@ -0,0 +1,84 @@
+#pragma once
+#include "win64s.h"
+#include "server.h"
+
+begin_c
+
+// Client to server rings. Every client slot has a ring of variable length
+// records in a mapping of its own: only the client of the slot is given
+// its handle. The client is the only writer, the server drains all rings
+// on one thread. Records are [upload_record_t][payload padded to 8 bytes];
+// a record that would straddle the end of the ring is preceded by a
+// padding record up to the end.
+//
+// Doorbell coalescing: the first record after the server started draining
+// a ring raises its `rung` flag, sets the slot bit in the `ready` bitmap
+// of server shared memory and publishes the doorbell. Records written
+// while `rung` is raised cost a memcpy and no wake.
+//
+// Calls: client.set() writes an upload_type_call record and waits on the
+// `replied` broadcast of its own ring until `answered` covers it. A futex
+// wake each way instead of a round trip over the control transport.
+
+enum {
+    upload_ring_bytes   = 256 * 1024, // data of each client ring, power of 2
+    upload_max_record   = 60 * 1024,  // payload bytes of one record
+    upload_full         = -1,         // uploads.write() results
+    upload_too_long     = -2,
+    upload_type_padding = 0,          // fills the ring up to its end
+    upload_type_set     = 1,          // "name\0value\0" applied to kv table
+    upload_type_call    = 2,          // same as set, the client waits for `result`
+    upload_type_corrupt = 15,         // reported by read() for a malformed record, the rest is dropped
+    upload_type_user    = 16          // and above: passed to server.upload()
+};
+
+typedef struct upload_record_s {
+    uint32_t bytes; // of payload
+    uint32_t type;
+    // followed by payload padded to 8 bytes
+} upload_record_t;
+
+typedef struct shared_upload_s { // one mapping per client slot
+    volatile uint64_t head; // written by client: bytes ever written, records below are complete
+    byte padding0[cache_line - 8];
+    volatile uint64_t tail; // written by server: bytes ever drained, client may reuse them
+    byte padding1[cache_line - 8];
+    volatile int32_t rung;  // raised by client with the doorbell, lowered by server on drain
+    byte padding2[cache_line - 4];
+    // written by server:
+    volatile uint64_t answered; // upload_type_call records applied
+    volatile int32_t result;    // of the last of them, written before `answered`
+    int32_t reserved;
+    volatile uint64_t parity[2]; // (Windows) server's `replied` events, the client duplicates them
+    broadcast_shared_t replied;  // published after `answered` moves
+    byte padding3[cache_line - 32 - sizeof(broadcast_shared_t)];
+    byte data[upload_ring_bytes];
+} shared_upload_t;
+
+typedef struct shared_doorbell_s { // in server shared memory
+    broadcast_shared_t bell;   // published by clients that raised `rung`
+    uint32_t slots;            // number of bits in ready[]
+    uint32_t reserved;
+    volatile uint64_t ready[]; // bit per client slot with records to drain
+} shared_doorbell_t;
+
+typedef struct uploads_if {
+    uint64_t (*size)(int clients); // of shared_doorbell_t
+    void (*layout)(shared_memory_t* sm, uint64_t offset, int clients);
+    volatile shared_doorbell_t* (*doorbell)(volatile shared_memory_t* sm);
+    // client: copies the record into the ring, 0, upload_full if there is
+    // no room until the server drains or upload_too_long
+    int (*write)(volatile shared_upload_t* u, uint32_t type, const void* data, uint32_t bytes);
+    // server: calls record() for each complete record in place, then hands
+    // the space back to the client; returns number of records. Payload is
+    // in memory the client can write: it must be validated while it is used.
+    // Records are never longer than upload_max_record: a header that says
+    // otherwise (or runs past head or the ring end) is reported once as
+    // upload_type_corrupt with no payload and the rest of the ring is dropped
+    int (*read)(volatile shared_upload_t* u, void* that,
+                void (*record)(void* that, uint32_t type, const byte* data, uint32_t bytes));
+} uploads_if;
+
+extern uploads_if uploads;
+
+end_c
@@ -1,4 +1,5 @@
 #include "win64s.h"
+#ifdef _WIN32
 #include <rpc.h>
 
 begin_c
@@ -73,6 +74,31 @@ heap_i heap = { allocate, deallocate };
 void* __RPC_USER MIDL_user_allocate(size_t bytes) { return heap.alloc(bytes); }
 void  __RPC_USER MIDL_user_free(void* p) { heap.free(p); }
 
+uint64_t nanoseconds_since_boot() {
+    LARGE_INTEGER li;
+    QueryPerformanceCounter(&li);
+    static uint64_t freq;
+    if (freq == 0) {
+        LARGE_INTEGER f;
+        QueryPerformanceFrequency(&f);
+        freq = (uint64_t)f.QuadPart;
+    }
+    const uint64_t t = (uint64_t)li.QuadPart; // split: t * 1e9 overflows after ~15 minutes at 10MHz
+    return t / freq * 1000 * 1000 * 1000 + t % freq * 1000 * 1000 * 1000 / freq;
+}
+
+bool cycles_invariant() {
+#if defined(_M_X64) || defined(_M_IX86)
+    int r[4];
+    __cpuid(r, 0x80000000);
+    if ((uint32_t)r[0] < 0x80000007) { return false; }
+    __cpuid(r, 0x80000007);
+    return (r[3] & (1 << 8)) != 0; // invariant TSC
+#else
+    return false;
+#endif
+}
+
 double seconds_since_boot() {
     LARGE_INTEGER li;
     QueryPerformanceCounter(&li);
@@ -153,6 +179,8 @@ static void handles_close(handle_t handle) {
 
 static handle_t handles_dup(handle_t s, handle_t process_from, handle_t process_to) {
     handle_t d = null;
+    if (process_from == null) { process_from = GetCurrentProcess(); }
+    if (process_to == null) { process_to = GetCurrentProcess(); }
     fatal_if_false(DuplicateHandle(process_from, s, process_to, &d, 0, false, DUPLICATE_SAME_ACCESS),
         "s=%p process_from=%p process_to=%p", s, process_from, process_to);
     return d;
@@ -255,4 +283,174 @@ threads_if threads = {
     threads_join
 };
 
+static void mutexes_init(mutex_t* m) {
+    fatal_if_false(InitializeCriticalSectionAndSpinCount(m, 4096));
+}
+
+static void mutexes_lock(mutex_t* m) { EnterCriticalSection(m); }
+
+static bool mutexes_try_lock(mutex_t* m) { return TryEnterCriticalSection(m); }
+
+static void mutexes_unlock(mutex_t* m) { LeaveCriticalSection(m); }
+
+static void mutexes_dispose(mutex_t* m) { DeleteCriticalSection(m); }
+
+mutexes_if mutexes = {
+    mutexes_init,
+    mutexes_lock,
+    mutexes_try_lock,
+    mutexes_unlock,
+    mutexes_dispose
+};
+
+static handle_t mappings_create(uint64_t bytes) {
+    handle_t mapping = null;
+    fatal_if_null(mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, null, PAGE_READWRITE,
+        (uint32_t)(bytes >> 32), (uint32_t)bytes, null));
+    return mapping;
+}
+
+static uint64_t mappings_large_page_size() { return GetLargePageMinimum(); }
+
+static bool enable_lock_memory_privilege() { // large pages need SeLockMemoryPrivilege
+    handle_t token = null;
+    bool enabled = OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token);
+    if (enabled) {
+        TOKEN_PRIVILEGES tp = { 0 };
+        tp.PrivilegeCount = 1;
+        tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+        enabled = LookupPrivilegeValueA(null, "SeLockMemoryPrivilege", &tp.Privileges[0].Luid) &&
+                  AdjustTokenPrivileges(token, false, &tp, 0, null, null) &&
+                  GetLastError() == ERROR_SUCCESS; // not ERROR_NOT_ALL_ASSIGNED
+        handles.close(token);
+    }
+    return enabled;
+}
+
+static handle_t mappings_create_placed(uint64_t bytes, bool large, int node) {
+    if (large && !enable_lock_memory_privilege()) { return null; }
+    // large pages are committed (and non pageable) when the section is created
+    return CreateFileMappingNumaA(INVALID_HANDLE_VALUE, null,
+        PAGE_READWRITE | (large ? SEC_COMMIT | SEC_LARGE_PAGES : 0),
+        (uint32_t)(bytes >> 32), (uint32_t)bytes, null,
+        node >= 0 ? (DWORD)node : NUMA_NO_PREFERRED_NODE);
+}
+
+static bool mappings_lock(void* address, uint64_t bytes) {
+    for (uint64_t i = 0; i < bytes; i += 4096) { (void)((volatile byte*)address)[i]; }
+    // VirtualLock() is limited by the minimum working set size
+    SIZE_T min_ws = 0;
+    SIZE_T max_ws = 0;
+    return GetProcessWorkingSetSize(GetCurrentProcess(), &min_ws, &max_ws) &&
+           SetProcessWorkingSetSize(GetCurrentProcess(), min_ws + (SIZE_T)bytes, max_ws + (SIZE_T)bytes) &&
+           VirtualLock(address, (SIZE_T)bytes);
+}
+
+static void* mappings_map(handle_t mapping, uint64_t bytes, bool writable) {
+    void* address = null;
+    fatal_if_null(address = MapViewOfFile(mapping, writable ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ,
+        0, 0, (size_t)bytes));
+    return address;
+}
+
+static void mappings_unmap(void* address, uint64_t bytes) {
+    fatal_if_false(UnmapViewOfFile(address));
+}
+
+static handle_t mappings_file(const char* filename, uint64_t* bytes, bool writable) {
+    handle_t file = CreateFileA(filename, writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_WRITE, null, writable ? OPEN_ALWAYS : OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL, null);
+    if (file == INVALID_HANDLE_VALUE) { return null; }
+    LARGE_INTEGER size;
+    size.QuadPart = (LONGLONG)*bytes;
+    bool ok = writable ? SetFilePointerEx(file, size, null, FILE_BEGIN) && SetEndOfFile(file) :
+                         GetFileSizeEx(file, &size) != 0;
+    if (ok && !writable) { *bytes = (uint64_t)size.QuadPart; }
+    // the section keeps the file open (empty files cannot be mapped)
+    handle_t mapping = ok && size.QuadPart > 0 ? CreateFileMappingA(file, null,
+        writable ? PAGE_READWRITE : PAGE_READONLY, 0, 0, null) : null;
+    handles.close(file);
+    return mapping;
+}
+
+mappings_if mappings = {
+    mappings_create,
+    mappings_create_placed,
+    mappings_map,
+    mappings_unmap,
+    mappings_large_page_size,
+    mappings_lock,
+    mappings_file
+};
+
+static void broadcasts_init(broadcast_t* b, broadcast_shared_t* shared, handle_t parity[2]) {
+    memset(b, 0, sizeof(*b));
+    b->shared = shared;
+    for (int i = 0; i < countof(b->parity); i++) {
+        b->parity[i] = parity != null ? parity[i] : events.create_manual();
+    }
+    b->interrupt = events.create();
+}
+
+static int32_t broadcasts_publish(broadcast_t* b) {
+    const int32_t g = InterlockedIncrement((volatile LONG*)&b->shared->generation);
+    events.set(b->parity[g & 1]);
+    events.reset(b->parity[(g + 1) & 1]);
+    return g;
+}
+
+static bool broadcasts_wait(broadcast_t* b, int32_t* seen, uint32_t ms) {
+    int32_t g = b->shared->generation;
+    if (g == *seen && !b->interrupted) {
+        // if two generations were published since `seen` was read the
+        // event below has been reset already and wait lasts till the next one
+        handle_t h[2] = { b->parity[(*seen + 1) & 1], b->interrupt };
+        events.wait_any_or_timeout(countof(h), h, ms);
+        g = b->shared->generation;
+    }
+    const bool advanced = g != *seen;
+    *seen = g;
+    return advanced;
+}
+
+static void broadcasts_interrupt(broadcast_t* b) {
+    b->interrupted = true;
+    events.set(b->interrupt);
+}
+
+static void broadcasts_dispose(broadcast_t* b) {
+    for (int i = 0; i < countof(b->parity); i++) { events.dispose(b->parity[i]); }
+    events.dispose(b->interrupt);
+    memset(b, 0, sizeof(*b));
+}
+
+broadcasts_if broadcasts = {
+    broadcasts_init,
+    broadcasts_publish,
+    broadcasts_wait,
+    broadcasts_interrupt,
+    broadcasts_dispose
+};
+
+end_c
+
+#endif // _WIN32
+
+begin_c // portable
+
+bool option(int argc, const char* argv[], const char* name) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], name) == 0) { return true; }
+    }
+    return false;
+}
+
+const char* option_value(int argc, const char* argv[], const char* name) {
+    for (int i = 1; i < argc - 1; i++) {
+        if (strcmp(argv[i], name) == 0) { return argv[i + 1]; }
+    }
+    return null;
+}
+
 end_c
@@ -1,14 +1,24 @@
 #pragma once
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <memory.h>
 #include <assert.h>
+#ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN 
 #define VC_EXTRALEAN 
 #include <windows.h>
+#include <intrin.h>
+#else
+#include <errno.h>
+#include <pthread.h>
+#define sleep posix_sleep // unistd.h sleep(unsigned) collides with sleep(double) below
+#include <unistd.h>
+#undef sleep
+#endif
 
 // w64s stands for "Windows 64 bit Simplistic" because
 // 1. Windows.h and "Win32" ALLCAPS APIs is a bit rude in 2021
@@ -16,6 +26,8 @@
 //    "repeated use of all caps can be considered `shouting` or irritating.
 // 2. Checking error codes at all call sites for invalid parameters
 //    and handling that as fatal errors better be done once.
+// Same interfaces are implemented for Linux in linux64s.c
+// (futex based events, pthreads, CLOCK_MONOTONIC_RAW timing).
 
 #ifdef __cplusplus
 #define begin_c extern "C" {
@@ -29,16 +41,132 @@ begin_c
 
 typedef unsigned char byte;
 
-typedef HANDLE handle_t;
-
 #define null ((void*)0)
 
-#define thread_local __declspec(thread)
-
 #define countof(a) (sizeof(a) / sizeof((a)[0]))
 
+// file scope compile time assertion (C99 has no _Static_assert, MSVC C neither)
+#define static_assertion(e) static_assertion_(e, __COUNTER__)
+#define static_assertion_(e, n) static_assertion__(e, n)
+#define static_assertion__(e, n) typedef char static_assertion_##n[(e) ? 1 : -1]
+
+// Bytes of destructive interference. Shared memory structures written by
+// different threads or processes are padded to it; server and clients must
+// agree: build everything with -Dcache_line=128 for Apple M and other cores
+// with 128 byte lines (or adjacent line prefetch pairs on x64).
+#ifndef cache_line
+#define cache_line 64
+#endif
+
+#ifdef _WIN32
+
+typedef HANDLE handle_t;
+
+#define thread_local __declspec(thread)
+
 #define forever INFINITE
 
+#define last_error_code() GetLastError()
+
+#define process_id() ((uint32_t)GetCurrentProcessId())
+
+#define spin_pause() YieldProcessor()
+
+#define thread_yield() SwitchToThread() // lets other ready threads run on this core
+
+#define processors_count() ((int)GetActiveProcessorCount(ALL_PROCESSOR_GROUPS))
+
+#if defined(_M_X64) || defined(_M_IX86)
+#define cycles() __rdtsc()
+#else
+#define cycles() nanoseconds_since_boot()
+#endif
+
+// atomics return the new value, exchange returns the previous one,
+// compare_exchange returns true on success:
+#define atomic_add32(p, v) InterlockedAdd((volatile LONG*)(p), (v))
+#define atomic_add64(p, v) InterlockedAdd64((volatile LONG64*)(p), (v))
+#define atomic_or64(p, v)  (InterlockedOr64((volatile LONG64*)(p), (v)) | (v))
+#define atomic_and64(p, v) (InterlockedAnd64((volatile LONG64*)(p), (v)) & (v))
+#define atomic_exchange64(p, v) InterlockedExchange64((volatile LONG64*)(p), (v))
+#define atomic_compare_exchange32(p, expected, desired) \
+    (InterlockedCompareExchange((volatile LONG*)(p), (desired), (expected)) == (LONG)(expected))
+// statistics counters: no ordering with respect to other memory accesses
+#define counter_add64(p, v) ((void)InterlockedAddNoFence64((volatile LONG64*)(p), (v)))
+// raises the counter to v unless it is already higher (maxima of concurrent writers)
+#define counter_max64(p, v) do {                                                          \
+    const LONG64 _v_ = (LONG64)(v);                                                     \
+    LONG64 _o_ = *(volatile LONG64*)(p);                                                \
+    while ((uint64_t)_o_ < (uint64_t)_v_) {                                             \
+        const LONG64 _r_ = InterlockedCompareExchangeNoFence64((volatile LONG64*)(p), _v_, _o_); \
+        if (_r_ == _o_) { break; }                                                      \
+        _o_ = _r_;                                                                      \
+    }                                                                                   \
+} while (0)
+
+#if defined(_M_X64) || defined(_M_IX86) // x86/x64 does not reorder loads with loads and stores with stores
+#define fence_acquire() _ReadWriteBarrier()
+#define fence_release() _ReadWriteBarrier()
+#else
+#define fence_acquire() MemoryBarrier()
+#define fence_release() MemoryBarrier()
+#endif
+
+#else
+
+typedef void* handle_t; // linux64s.c handles: events, threads and file descriptors
+
+#define WINAPI
+
+#define thread_local __thread
+
+#define forever ((uint32_t)-1)
+
+#define last_error_code() ((uint32_t)errno)
+
+#define process_id() ((uint32_t)getpid())
+
+#if defined(__x86_64__) || defined(__i386__)
+#define spin_pause() __builtin_ia32_pause()
+#elif defined(__aarch64__) || defined(__arm__)
+#define spin_pause() __asm__ __volatile__("yield")
+#else
+#define spin_pause() do { } while (0)
+#endif
+
+#define thread_yield() sched_yield() // lets other ready threads run on this core
+
+#define processors_count() ((int)sysconf(_SC_NPROCESSORS_ONLN))
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cycles() __builtin_ia32_rdtsc()
+#elif defined(__aarch64__)
+#define cycles() __extension__ ({ uint64_t _v_; __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(_v_)); _v_; })
+#else
+#define cycles() nanoseconds_since_boot()
+#endif
+
+#define atomic_add32(p, v) __atomic_add_fetch((p), (v), __ATOMIC_SEQ_CST)
+#define atomic_add64(p, v) __atomic_add_fetch((p), (v), __ATOMIC_SEQ_CST)
+#define atomic_or64(p, v)  __atomic_or_fetch((p), (v), __ATOMIC_SEQ_CST)
+#define atomic_and64(p, v) __atomic_and_fetch((p), (v), __ATOMIC_SEQ_CST)
+#define atomic_exchange64(p, v) __atomic_exchange_n((p), (v), __ATOMIC_SEQ_CST)
+#define atomic_compare_exchange32(p, expected, desired) __extension__ ({ \
+    __typeof__(*(p) + 0) _e_ = (expected); \
+    __atomic_compare_exchange_n((p), &_e_, (desired), false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST); })
+#define counter_add64(p, v) ((void)__atomic_fetch_add((p), (v), __ATOMIC_RELAXED))
+#define counter_max64(p, v) do {                                                          \
+    const uint64_t _v_ = (v);                                                           \
+    uint64_t _o_ = __atomic_load_n((p), __ATOMIC_RELAXED);                              \
+    while (_o_ < _v_ &&                                                                 \
+           !__atomic_compare_exchange_n((p), &_o_, _v_, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) { } \
+} while (0)
+
+#define fence_acquire() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define fence_release() __atomic_thread_fence(__ATOMIC_RELEASE)
+
+#endif
+
 const char* error_to_string(uint32_t e);
 
 const char* last_error();
@@ -56,16 +184,28 @@ void fatal_windows_error(const char* file, int line, const char* function,
 
 double seconds_since_boot();
 
+uint64_t nanoseconds_since_boot(); // integer: precision does not degrade with uptime
+
+// cycles() counts at constant rate on all cores and in all power states
+// (x86 invariant TSC, arm64 virtual counter) when cycles_invariant(),
+// otherwise its rate is unknown and it must not be used for timing
+bool cycles_invariant();
+
 void sleep(double seconds);
 
 const char* timestamp_string();
 
+// command line, argv[0] is not an option:
+bool option(int argc, const char* argv[], const char* name); // name is present
+// argument that follows name, null if name is absent or last
+const char* option_value(int argc, const char* argv[], const char* name);
+
 typedef struct heap_i {
     void* (*alloc)(uint64_t bytes);
     void (*free)(void* p);
 } heap_i;
 
-heap_i heap;
+extern heap_i heap;
 
 void traceline(const char* file, int line, const char* function, const char* format, ...);
 
@@ -82,9 +222,9 @@ void assertion_failed(const char* file, int line, const char* function,
         } \
     } while (0)
 
-#define fatal_if_false(win32_api_call, ...) fatal_if_false_(win32_api_call, #win32_api_call, GetLastError(), __VA_ARGS__)
+#define fatal_if_false(win32_api_call, ...) fatal_if_false_(win32_api_call, #win32_api_call, last_error_code(), __VA_ARGS__)
 
-#define fatal_if_null(win32_api_call, ...) fatal_if_false_((win32_api_call) != null, #win32_api_call, GetLastError(), __VA_ARGS__)
+#define fatal_if_null(win32_api_call, ...) fatal_if_false_((win32_api_call) != null, #win32_api_call, last_error_code(), __VA_ARGS__)
 
 #define fatal_if_not_zero(win32_api_call, ...) \
     do { \
@@ -94,16 +234,25 @@ void assertion_failed(const char* file, int line, const char* function,
 
 typedef struct thread_s {
     void* that;
-    HANDLE events[2];
-    HANDLE thread;
+    handle_t events[2];
+    handle_t thread;
 } thread_t;
 
+#ifdef _WIN32
 
 #define soft_realtime_thread() {                                                            \
     fatal_if_false(SetPriorityClass(GetCurrentProcess(), REALTIME_PRIORITY_CLASS));         \
     fatal_if_false(SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL));   \
 }
 
+#else
+
+void posix_soft_realtime_thread(); // SCHED_FIFO when permitted, silently ignored otherwise
+
+#define soft_realtime_thread() posix_soft_realtime_thread()
+
+#endif
+
 #define thread_begin(p)             \
     thread_t* self = (thread_t*)p;   \
     void* that = self->that;         \
@@ -130,6 +279,7 @@ static uint32_t WINAPI proc(void* _thread_) {
 
 typedef struct {
     bool (*is_valid)(handle_t h);
+    // null process_from and process_to: a duplicate inside this process
     handle_t (*dup)(handle_t s, handle_t process_from, handle_t process_to);
     void (*close)(handle_t h);
 } handles_if;
@@ -160,4 +310,75 @@ typedef struct {
 
 extern threads_if threads;
 
+#ifdef _WIN32
+typedef CRITICAL_SECTION mutex_t;
+#else
+typedef pthread_mutex_t mutex_t;
+#endif
+
+typedef struct {
+    void (*init)(mutex_t* m); // spins a bit before blocking
+    void (*lock)(mutex_t* m);
+    bool (*try_lock)(mutex_t* m); // false if already locked
+    void (*unlock)(mutex_t* m);
+    void (*dispose)(mutex_t* m);
+} mutexes_if;
+
+extern mutexes_if mutexes;
+
+typedef struct {
+    handle_t (*create)(uint64_t bytes); // anonymous shared memory
+    // large: backed by large pages, bytes must be a multiple of large_page_size();
+    // node >= 0: pages come from that NUMA node. null if either is not available
+    handle_t (*create_placed)(uint64_t bytes, bool large, int node);
+    void* (*map)(handle_t mapping, uint64_t bytes, bool writable);
+    void (*unmap)(void* address, uint64_t bytes);
+    uint64_t (*large_page_size)(); // 0 if there are none
+    // faults all pages of the mapped range in and locks them in physical
+    // memory; false if locking is not permitted (pages are still faulted in)
+    bool (*lock)(void* address, uint64_t bytes);
+    // file backed: writable opens or creates the file and resizes it to
+    // *bytes (growth reads as zeros); read only opens an existing file and
+    // returns its size in *bytes. null if the file cannot be opened
+    handle_t (*file)(const char* filename, uint64_t* bytes, bool writable);
+} mappings_if;
+
+extern mappings_if mappings;
+
+typedef struct broadcast_shared_s { // in memory shared between processes
+    volatile int32_t generation; // incremented by each publish()
+    volatile int32_t waiters;    // Linux: blocked in futex wait, no syscall when 0
+} broadcast_shared_t;
+
+typedef struct broadcast_s {
+    broadcast_shared_t* shared;
+    // WaitOnAddress() does not work across processes. On Windows waiters
+    // block on a pair of manual reset events: parity[g & 1] is set and
+    // parity[(g + 1) & 1] is reset when generation `g` is published.
+    handle_t parity[2];
+    handle_t interrupt; // Windows: wakes wait() in this process only
+    volatile int32_t waiting; // Linux: threads of this process inside wait()
+    volatile bool interrupted;
+} broadcast_t;
+
+typedef struct {
+    // parity == null creates events (publisher), otherwise takes ownership of them
+    void (*init)(broadcast_t* b, broadcast_shared_t* shared, handle_t parity[2]);
+    int32_t (*publish)(broadcast_t* b); // wakes all waiters in all processes
+    // returns true and updates `seen` when generation != *seen,
+    // false on timeout or interrupt()
+    bool (*wait)(broadcast_t* b, int32_t* seen, uint32_t milliseconds);
+    void (*interrupt)(broadcast_t* b);
+    void (*dispose)(broadcast_t* b);
+} broadcasts_if;
+
+extern broadcasts_if broadcasts;
+
+#ifndef _WIN32
+// file descriptors interop for uds.c transport (SCM_RIGHTS):
+// exported events become "shared" and set() always rings eventfd
+int posix_handle_export(handle_t h);
+handle_t posix_handle_import(int fd, bool event); // takes ownership of fd
+#endif
+
 end_c